@@ -14,6 +14,7 @@
 # pragma clang diagnostic ignored "-Wold-style-cast"
 #endif
 #include <wx/arrstr.h>
+#include <wx/checkbox.h>
 #include <wx/choice.h>
 #include <wx/gbsizer.h>
 #include <wx/listbox.h>
@@ -47,4 +48,16 @@ XSFConfigDialog_2SF::XSFConfigDialog_2SF(XSFConfig &newConfig, wxWindow *parent,
 		muteChoices.Add("SPU " + std::to_string(i + 1));
 	auto muteListBox = new wxListBox(this->outputPanel, wxID_ANY, wxDefaultPosition, wxDefaultSize, muteChoices, wxLB_MULTIPLE, wxGenericValidator{ &this->mute });
 	this->outputSizer->Add(muteListBox, { 5, 1 }, { 1, 1 }, wxALL, 5);
+
+	auto timingLabel = new wxStaticText(this->outputPanel, wxID_ANY, "Timing");
+	this->outputSizer->Add(timingLabel, { 6, 0 }, { 1, 1 }, wxALIGN_CENTER_VERTICAL | wxALL, 5);
+	wxArrayString timingChoices;
+	timingChoices.Add("Cache Simulation");
+	timingChoices.Add("Region Table");
+	timingChoices.Add("Fixed");
+	auto timingChoice = new wxChoice(this->outputPanel, wxID_ANY, wxDefaultPosition, wxDefaultSize, timingChoices, 0, wxGenericValidator{ &this->timing });
+	this->outputSizer->Add(timingChoice, { 6, 1 }, { 1, 1 }, wxALL, 5);
+
+	auto validateTimingCheckBox = new wxCheckBox(this->outputPanel, wxID_ANY, "Validate Timing Against Cache Simulation", wxDefaultPosition, wxDefaultSize, 0, wxGenericValidator{ &this->validateTiming });
+	this->outputSizer->Add(validateTimingCheckBox, { 7, 0 }, { 1, 2 }, wxALL, 5);
 }
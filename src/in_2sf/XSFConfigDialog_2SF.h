@@ -33,4 +33,6 @@ public:
 
 	int interpolation;
 	wxArrayInt mute;
+	int timing;
+	bool validateTiming;
 };
@@ -36,7 +36,7 @@ XSFConfig *XSFConfig::Create()
 	return new XSFConfig_2SF();
 }
 
-XSFConfig_2SF::XSFConfig_2SF() : XSFConfig(), interpolation(0), mutes()
+XSFConfig_2SF::XSFConfig_2SF() : XSFConfig(), interpolation(0), mutes(), timing(0), validateTiming(false)
 {
 	this->supportedSampleRates.push_back(static_cast<unsigned>(DESMUME_SAMPLE_RATE));
 }
@@ -46,12 +46,18 @@ void XSFConfig_2SF::LoadSpecificConfig()
 	this->interpolation = this->configIO->GetValue("Interpolation", XSFConfig_2SF::initInterpolation);
 	std::stringstream mutesSS(this->configIO->GetValue("Mutes", XSFConfig_2SF::initMutes));
 	mutesSS >> this->mutes;
+	this->timing = this->configIO->GetValue("Timing", XSFConfig_2SF::initTiming);
+	if (this->timing > NDS_TIMING_PROFILE_FIXED)
+		this->timing = XSFConfig_2SF::initTiming;
+	this->validateTiming = this->configIO->GetValue("ValidateTiming", XSFConfig_2SF::initValidateTiming);
 }
 
 void XSFConfig_2SF::SaveSpecificConfig()
 {
 	this->configIO->SetValue("Interpolation", this->interpolation);
 	this->configIO->SetValue("Mutes", this->mutes.to_string<char>());
+	this->configIO->SetValue("Timing", this->timing);
+	this->configIO->SetValue("ValidateTiming", this->validateTiming);
 }
 
 void XSFConfig_2SF::InitializeSpecificConfigDialog(XSFConfigDialog *dialog)
@@ -61,6 +67,8 @@ void XSFConfig_2SF::InitializeSpecificConfigDialog(XSFConfigDialog *dialog)
 	for (std::size_t x = 0, numMutes = this->mutes.size(); x < numMutes; ++x)
 		if (this->mutes[x])
 			twosfDialog->mute.Add(x);
+	twosfDialog->timing = static_cast<int>(this->timing);
+	twosfDialog->validateTiming = this->validateTiming;
 }
 
 void XSFConfig_2SF::ResetSpecificConfigDefaults(XSFConfigDialog *dialog)
@@ -72,6 +80,8 @@ void XSFConfig_2SF::ResetSpecificConfigDefaults(XSFConfigDialog *dialog)
 	for (std::size_t x = 0, numMutes = tmpMutes.size(); x < numMutes; ++x)
 		if (tmpMutes[x])
 			twosfDialog->mute.Add(x);
+	twosfDialog->timing = XSFConfig_2SF::initTiming;
+	twosfDialog->validateTiming = XSFConfig_2SF::initValidateTiming;
 }
 
 void XSFConfig_2SF::SaveSpecificConfigDialog(XSFConfigDialog *dialog)
@@ -80,11 +90,18 @@ void XSFConfig_2SF::SaveSpecificConfigDialog(XSFConfigDialog *dialog)
 	this->interpolation = twosfDialog->interpolation;
 	for (std::size_t x = 0, numMutes = this->mutes.size(); x < numMutes; ++x)
 		this->mutes[x] = twosfDialog->mute.Index(x) != wxNOT_FOUND;
+	this->timing = twosfDialog->timing;
+	this->validateTiming = twosfDialog->validateTiming;
 }
 
 void XSFConfig_2SF::CopySpecificConfigToMemory(XSFPlayer *, bool preLoad)
 {
-	if (!preLoad)
+	if (preLoad)
+	{
+		CommonSettings.timing_profile = static_cast<NDS_TIMING_PROFILE>(this->timing);
+		CommonSettings.timing_validate = this->validateTiming;
+	}
+	else
 	{
 		CommonSettings.spuInterpolationMode = static_cast<SPUInterpolationMode>(this->interpolation);
 		for (std::size_t x = 0, numMutes = this->mutes.size(); x < numMutes; ++x)
@@ -21,10 +21,14 @@ class XSFConfig_2SF : public XSFConfig
 protected:
 	static constexpr unsigned initInterpolation = 2;
 	inline static const std::string initMutes = "0000000000000000";
+	static constexpr unsigned initTiming = 1;
+	static constexpr bool initValidateTiming = false;
 
 	friend class XSFConfig;
 	unsigned interpolation;
 	std::bitset<16> mutes;
+	unsigned timing;
+	bool validateTiming;
 
 	XSFConfig_2SF();
 	void LoadSpecificConfig() override;
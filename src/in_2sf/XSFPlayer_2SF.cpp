@@ -13,29 +13,13 @@
 #include <algorithm>
 #include <filesystem>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 #include <cstdint>
 #include <zlib.h>
 #include "XSFCommon.h"
-#include "XSFPlayer.h"
-#include "desmume/NDSSystem.h"
-
-class XSFPlayer_2SF : public XSFPlayer
-{
-	std::vector<std::uint8_t> rom;
-
-	void Map2SFSection(const std::vector<std::uint8_t> &section);
-	bool Map2SF(XSFFile *xSFToLoad);
-	bool RecursiveLoad2SF(XSFFile *xSFToLoad, int level);
-	bool Load2SF(XSFFile *xSFToLoad);
-public:
-	XSFPlayer_2SF(const std::filesystem::path &path);
-	~XSFPlayer_2SF() override { this->Terminate(); }
-	bool Load() override;
-	void GenerateSamples(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples) override;
-	void Terminate() override;
-};
+#include "XSFPlayer_2SF.h"
 
 const char *XSFPlayer::WinampDescription = "2SF Decoder";
 const char *XSFPlayer::WinampExts = "2sf;mini2sf\0DS Sound Format files (*.2sf;*.mini2sf)\0";
@@ -49,21 +33,16 @@ volatile bool execute = false;
 
 static struct
 {
-	std::vector<std::uint8_t> buf;
-	unsigned filled, used;
-	std::uint32_t bufferbytes, cycles;
+	std::uint32_t cycles;
 	int xfs_load, sync_type;
-} sndifwork = { std::vector<std::uint8_t>(), 0, 0, 0, 0, 0, 0 };
+} sndifwork = { 0, 0, 0 };
 
+// The SPU mixes straight into the buffer given to GenerateSamples (see SPU_SetSink),
+// so the sound core itself never gets any audio to pass on.
 static void SNDIFDeInit() { }
 
-static int SNDIFInit(int buffersize)
+static int SNDIFInit(int)
 {
-	std::uint32_t bufferbytes = buffersize * sizeof(std::int16_t);
-	SNDIFDeInit();
-	sndifwork.buf.resize(bufferbytes + 3);
-	sndifwork.bufferbytes = bufferbytes;
-	sndifwork.filled = sndifwork.used = 0;
 	sndifwork.cycles = 0;
 	return 0;
 }
@@ -71,21 +50,8 @@ static int SNDIFInit(int buffersize)
 static void SNDIFMuteAudio() { }
 static void SNDIFUnMuteAudio() { }
 static void SNDIFSetVolume(int) { }
-
-static std::uint32_t SNDIFGetAudioSpace()
-{
-	return sndifwork.bufferbytes >> 2; // bytes to samples
-}
-
-static void SNDIFUpdateAudio(std::int16_t *buffer, std::uint32_t num_samples)
-{
-	std::uint32_t num_bytes = num_samples << 2;
-	if (num_bytes > sndifwork.bufferbytes)
-		num_bytes = sndifwork.bufferbytes;
-	std::copy_n(reinterpret_cast<std::uint8_t *>(buffer), num_bytes, &sndifwork.buf[0]);
-	sndifwork.filled = num_bytes;
-	sndifwork.used = 0;
-}
+static std::uint32_t SNDIFGetAudioSpace() { return 0; }
+static void SNDIFUpdateAudio(std::int16_t *, std::uint32_t) { }
 
 static const int SNDIFID_2SF = 1;
 static SoundInterface_struct SNDIF_2SF =
@@ -177,14 +143,16 @@ XSFPlayer_2SF::XSFPlayer_2SF(const std::filesystem::path &path) : XSFPlayer()
 	this->xSF.reset(new XSFFile(path, 4, 8));
 }
 
-bool XSFPlayer_2SF::Load()
+// The values of the _2sf_timing tag, indexed by NDS_TIMING_PROFILE
+static const std::string timingProfileNames[] = { "cache", "region", "fixed" };
+static const unsigned TIMING_CHECK_SECONDS = 5;
+
+bool XSFPlayer_2SF::StartEmulation()
 {
 	int frames = this->xSF->GetTagValue("_frames", -1);
-	sndifwork.sync_type = this->xSF->GetTagValue("_2sf_sync_type", 0);
 
 	sndifwork.xfs_load = false;
-	if (!this->Load2SF(this->xSF.get()))
-		return false;
+	sndifwork.cycles = 0;
 
 	if (NDS_Init())
 		return false;
@@ -205,6 +173,9 @@ bool XSFPlayer_2SF::Load()
 	CommonSettings.jit_max_block_size = 100;
 	NDS_Reset();
 
+	// anything mixed while skipping frames is kept for the first GenerateSamples
+	SPU_SetSink(nullptr, 0);
+
 	execute = true;
 
 	if (frames > 0)
@@ -217,7 +188,63 @@ bool XSFPlayer_2SF::Load()
 	sndifwork.xfs_load = true;
 	CommonSettings.rigorous_timing = true;
 	CommonSettings.spu_advanced = true;
-	CommonSettings.advanced_timing = true;
+
+	return true;
+}
+
+bool XSFPlayer_2SF::RenderTimingCheck(NDS_TIMING_PROFILE profile, std::vector<std::uint8_t> &buf)
+{
+	CommonSettings.timing_profile = profile;
+	if (!this->StartEmulation())
+		return false;
+	unsigned samples = this->sampleRate * TIMING_CHECK_SECONDS;
+	buf.resize(samples << 2);
+	this->GenerateSamples(buf, 0, samples);
+	this->Terminate();
+	return true;
+}
+
+NDS_TIMING_PROFILE XSFPlayer_2SF::ResolveTimingProfile()
+{
+	// a rip can pin the profile it needs, whatever the configuration says
+	if (this->xSF->GetTagExists("_2sf_timing"))
+	{
+		std::string tag = this->xSF->GetTagValue("_2sf_timing");
+		auto name = std::find(std::begin(timingProfileNames), std::end(timingProfileNames), tag);
+		if (name != std::end(timingProfileNames))
+			return static_cast<NDS_TIMING_PROFILE>(name - std::begin(timingProfileNames));
+	}
+
+	auto profile = CommonSettings.timing_profile;
+	if (!CommonSettings.timing_validate || profile == NDS_TIMING_PROFILE_CACHE)
+		return profile;
+
+	// the cheaper profiles are only kept when the start of the song comes out bit-identical to the
+	// cache simulation, otherwise the file falls back to the cache simulation
+	std::vector<std::uint8_t> reference, check;
+	if (!this->RenderTimingCheck(NDS_TIMING_PROFILE_CACHE, reference) || !this->RenderTimingCheck(profile, check))
+		return NDS_TIMING_PROFILE_CACHE;
+	return reference == check ? profile : NDS_TIMING_PROFILE_CACHE;
+}
+
+bool XSFPlayer_2SF::Load()
+{
+	sndifwork.sync_type = this->xSF->GetTagValue("_2sf_sync_type", 0);
+
+	sndifwork.xfs_load = false;
+	// the ROM image only depends on the files, so the Terminate/Load pair of a backward seek reuses it
+	if (this->rom.empty() && !this->Load2SF(this->xSF.get()))
+	{
+		this->rom.clear();
+		return false;
+	}
+
+	if (!this->timingProfile)
+		this->timingProfile = this->ResolveTimingProfile();
+	CommonSettings.timing_profile = *this->timingProfile;
+
+	if (!this->StartEmulation())
+		return false;
 
 	return XSFPlayer::Load();
 }
@@ -234,60 +261,43 @@ void XSFPlayer_2SF::GenerateSamples(std::vector<std::uint8_t> &buf, unsigned off
 
 	if (!sndifwork.xfs_load)
 		return;
-	unsigned bytes = samples << 2;
-	while (bytes)
+	SPU_SetSink(reinterpret_cast<std::int16_t *>(&buf[offset]), samples);
+	while (SPU_SinkSpace())
 	{
-		unsigned remainbytes = sndifwork.filled - sndifwork.used;
-		if (remainbytes > 0)
+		if (sndifwork.sync_type == 1)
 		{
-			if (remainbytes > bytes)
-			{
-				std::copy_n(&sndifwork.buf[sndifwork.used], bytes, &buf[offset]);
-				sndifwork.used += bytes;
-				offset += bytes;
-				remainbytes -= bytes;
-				bytes = 0;
-				break;
-			}
+			/* vsync */
+			sndifwork.cycles += (this->sampleRate / VDIVISION) * HLINE_CYCLES * VLINES;
+			if (sndifwork.cycles >= static_cast<std::uint32_t>(VBASE_CYCLES * (VSAMPLES + 1)))
+				sndifwork.cycles -= static_cast<std::uint32_t>(VBASE_CYCLES * (VSAMPLES + 1));
 			else
-			{
-				std::copy_n(&sndifwork.buf[sndifwork.used], remainbytes, &buf[offset]);
-				sndifwork.used += remainbytes;
-				offset += remainbytes;
-				bytes -= remainbytes;
-				remainbytes = 0;
-			}
+				sndifwork.cycles -= static_cast<std::uint32_t>(VBASE_CYCLES * VSAMPLES);
 		}
-		if (!remainbytes)
+		else
 		{
-			if (sndifwork.sync_type == 1)
-			{
-				/* vsync */
-				sndifwork.cycles += (this->sampleRate / VDIVISION) * HLINE_CYCLES * VLINES;
-				if (sndifwork.cycles >= static_cast<std::uint32_t>(VBASE_CYCLES * (VSAMPLES + 1)))
-					sndifwork.cycles -= static_cast<std::uint32_t>(VBASE_CYCLES * (VSAMPLES + 1));
-				else
-					sndifwork.cycles -= static_cast<std::uint32_t>(VBASE_CYCLES * VSAMPLES);
-			}
+			/* hsync */
+			sndifwork.cycles += this->sampleRate * HLINE_CYCLES;
+			if (sndifwork.cycles >= static_cast<std::uint32_t>(HBASE_CYCLES * (HSAMPLES + 1)))
+				sndifwork.cycles -= static_cast<std::uint32_t>(HBASE_CYCLES * (HSAMPLES + 1));
 			else
-			{
-				/* hsync */
-				sndifwork.cycles += this->sampleRate * HLINE_CYCLES;
-				if (sndifwork.cycles >= static_cast<std::uint32_t>(HBASE_CYCLES * (HSAMPLES + 1)))
-					sndifwork.cycles -= static_cast<std::uint32_t>(HBASE_CYCLES * (HSAMPLES + 1));
-				else
-					sndifwork.cycles -= static_cast<std::uint32_t>(HBASE_CYCLES * HSAMPLES);
-			}
-			NDS_exec<false>();
-			SPU_Emulate_user();
+				sndifwork.cycles -= static_cast<std::uint32_t>(HBASE_CYCLES * HSAMPLES);
 		}
+		NDS_exec<false>();
 	}
+	SPU_SetSink(nullptr, 0);
 }
 
 void XSFPlayer_2SF::Terminate()
 {
 	MMU_unsetRom();
 	NDS_DeInit();
+}
 
-	this->rom.clear();
+JIT_profile XSFPlayer_2SF::GetJITProfile() const
+{
+#ifdef HAVE_JIT
+	return arm_jit_profile();
+#else
+	return JIT_profile();
+#endif
 }
@@ -0,0 +1,53 @@
+/*
+ * xSF - 2SF Player
+ * By Naram Qashat (CyberBotX) [cyberbotx@cyberbotx.com]
+ *
+ * Based on a modified vio2sf v0.22c
+ *
+ * Partially based on the vio*sf framework
+ *
+ * Utilizes a modified DeSmuME v0.9.9 SVN for playback
+ * http://desmume.org/
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+#include <cstdint>
+#include "XSFPlayer.h"
+#include "desmume/NDSSystem.h"
+#include "desmume/arm_jit.h"
+
+class XSFFile;
+
+class XSFPlayer_2SF : public XSFPlayer
+{
+	std::vector<std::uint8_t> rom;
+	// resolved by the first Load, so that the Load of a backward seek doesn't validate it again
+	std::optional<NDS_TIMING_PROFILE> timingProfile;
+
+	void Map2SFSection(const std::vector<std::uint8_t> &section);
+	bool Map2SF(XSFFile *xSFToLoad);
+	bool RecursiveLoad2SF(XSFFile *xSFToLoad, int level);
+	bool Load2SF(XSFFile *xSFToLoad);
+	bool StartEmulation();
+	bool RenderTimingCheck(NDS_TIMING_PROFILE profile, std::vector<std::uint8_t> &buf);
+	NDS_TIMING_PROFILE ResolveTimingProfile();
+public:
+	XSFPlayer_2SF(const std::filesystem::path &path);
+	~XSFPlayer_2SF() override { this->Terminate(); }
+	bool Load() override;
+	void GenerateSamples(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples) override;
+	void Terminate() override;
+
+	/*
+	 * JIT profiling, for finding out which 2SFs the JIT copes badly with.
+	 * Turning it on takes effect from the next Load, and GetJITProfile then
+	 * reports on everything emulated since that Load (see arm_jit_profile),
+	 * up until the Load after it, so it can still be fetched after Terminate.
+	 */
+	void SetJITProfiling(bool enable) { CommonSettings.jit_profile = enable; }
+	JIT_profile GetJITProfile() const;
+};
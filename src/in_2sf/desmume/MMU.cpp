@@ -17,7 +17,9 @@
 	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <bitset>
 #include <sstream>
+#include <cstddef>
 #include <cstdlib>
 #include <cmath>
 #include <cstring>
@@ -65,14 +67,29 @@ static uint64_t isqrt(uint64_t x)
 }
 
 uint32_t partie = 1;
-uint32_t _MMU_MAIN_MEM_MASK = 0x3FFFFF;
-uint32_t _MMU_MAIN_MEM_MASK16 = 0x3FFFFF & ~1;
-uint32_t _MMU_MAIN_MEM_MASK32 = 0x3FFFFF & ~3;
 
 MMU_struct MMU;
 MMU_struct_new MMU_new;
 MMU_struct_timing MMU_timing;
 
+// The emulator itself only ever writes registers within the first two 4KB pages of the 16MB ARM9 I/O
+// block. Any other page only gets written by the fallback at the end of the I/O branch of the ARM9
+// write handlers, which marks it here, so clearing the block only has to touch those pages.
+static std::bitset<(sizeof(MMU.ARM9_REG) >> 12)> ARM9_REG_dirty;
+
+static inline void MMU_ARM9_REG_markDirty(uint32_t adr)
+{
+	ARM9_REG_dirty.set((adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20]) >> 12);
+}
+
+static void MMU_clearARM9_REG()
+{
+	for (size_t page = 0; page < ARM9_REG_dirty.size(); ++page)
+		if (page < 2 || ARM9_REG_dirty[page])
+			memset(&MMU.ARM9_REG[page << 12], 0, 0x1000);
+	ARM9_REG_dirty.reset();
+}
+
 uint8_t *MMU_struct::MMU_MEM[2][256] =
 {
 	//arm9
@@ -715,7 +732,10 @@ static inline void MMU_VRAMmapControl(uint8_t block, uint8_t VRAMBankCnt)
 
 void MMU_Init()
 {
-	memset(&MMU, 0, sizeof(MMU_struct));
+	// everything but the I/O block, which only needs its written pages cleared
+	memset(&MMU, 0, offsetof(MMU_struct, ARM9_REG));
+	memset(&MMU.ARM9_BIOS, 0, sizeof(MMU_struct) - offsetof(MMU_struct, ARM9_BIOS));
+	MMU_clearARM9_REG();
 
 	MMU.CART_ROM = MMU.UNUSED_RAM;
 
@@ -744,7 +764,7 @@ void MMU_Reset()
 	memset(MMU.ARM9_ITCM, 0, sizeof(MMU.ARM9_ITCM));
 	memset(MMU.ARM9_LCD, 0, sizeof(MMU.ARM9_LCD));
 	memset(MMU.ARM9_OAM, 0, sizeof(MMU.ARM9_OAM));
-	memset(MMU.ARM9_REG, 0, sizeof(MMU.ARM9_REG));
+	MMU_clearARM9_REG();
 	memset(MMU.ARM9_VMEM, 0, sizeof(MMU.ARM9_VMEM));
 	memset(MMU.MAIN_MEM, 0, sizeof(MMU.MAIN_MEM));
 
@@ -827,18 +847,13 @@ void MMU_Reset()
 	MMU_timing.arm9dataFetch.Reset();
 	MMU_timing.arm9codeCache.Reset();
 	MMU_timing.arm9dataCache.Reset();
-}
-
-void SetupMMU(bool debugConsole, bool dsi)
-{
-	if (debugConsole)
-		_MMU_MAIN_MEM_MASK = 0x7FFFFF;
-	else
-		_MMU_MAIN_MEM_MASK = 0x3FFFFF;
-	if (dsi)
-		_MMU_MAIN_MEM_MASK = 0xFFFFFF;
-	_MMU_MAIN_MEM_MASK16 = _MMU_MAIN_MEM_MASK & ~1;
-	_MMU_MAIN_MEM_MASK32 = _MMU_MAIN_MEM_MASK & ~3;
+	// the fixed profile charges every ARM9 CPU access like a cache hit
+	bool fixed = CommonSettings.timing_profile == NDS_TIMING_PROFILE_FIXED;
+	for (uint32_t region = 0; region < 0x100; ++region)
+	{
+		MMU_timing.arm9Wait[0][region] = fixed ? 1 : MMU_regionAccesstime<ARMCPU_ARM9, 16>(region << 24);
+		MMU_timing.arm9Wait[1][region] = fixed ? 1 : MMU_regionAccesstime<ARMCPU_ARM9, 32>(region << 24);
+	}
 }
 
 void MMU_setRom(uint8_t *rom, uint32_t)
@@ -875,7 +890,7 @@ static void execsqrt()
 	MMU.sqrtCycles = nds_timer + 26;
 	MMU.sqrtResult = ret;
 	MMU.sqrtRunning = true;
-	NDS_Reschedule();
+	NDS_RescheduleSqrt();
 }
 
 static void execdiv()
@@ -929,7 +944,7 @@ static void execdiv()
 	MMU.divResult = res;
 	MMU.divMod = mod;
 	MMU.divRunning = true;
-	NDS_Reschedule();
+	NDS_RescheduleDivider();
 }
 
 DSI_TSC::DSI_TSC()
@@ -1674,6 +1689,7 @@ void FASTCALL _MMU_ARM9_write08(uint32_t adr, uint8_t val)
 				MMU_VRAMmapControl(adr - REG_VRAMCNTA, val);
 		}
 
+		MMU_ARM9_REG_markDirty(adr);
 		MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20][adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20]] = val;
 		return;
 	}
@@ -1683,6 +1699,8 @@ void FASTCALL _MMU_ARM9_write08(uint32_t adr, uint8_t val)
 		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0) = 0;
 #endif
 
+	sampleCache.notifyWrite(adr);
+
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20][adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20]] = val;
 }
@@ -1815,6 +1833,7 @@ void FASTCALL _MMU_ARM9_write16(uint32_t adr, uint16_t val)
 				return;
 		}
 
+		MMU_ARM9_REG_markDirty(adr);
 		T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20], val);
 		return;
 	}
@@ -1829,6 +1848,8 @@ void FASTCALL _MMU_ARM9_write16(uint32_t adr, uint16_t val)
 		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0) = 0;
 #endif
 
+	sampleCache.notifyWrite(adr);
+
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20], val);
 }
@@ -1964,6 +1985,7 @@ void FASTCALL _MMU_ARM9_write32(uint32_t adr, uint32_t val)
 				return;
 		}
 
+		MMU_ARM9_REG_markDirty(adr);
 		T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20], val);
 		return;
 	}
@@ -1981,6 +2003,8 @@ void FASTCALL _MMU_ARM9_write32(uint32_t adr, uint32_t val)
 	}
 #endif
 
+	sampleCache.notifyWrite(adr);
+
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20], val);
 }
@@ -2275,6 +2299,8 @@ void FASTCALL _MMU_ARM7_write08(uint32_t adr, uint8_t val)
 		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0) = 0;
 #endif
 
+	sampleCache.notifyWrite(adr);
+
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	MMU.MMU_MEM[ARMCPU_ARM7][adr >> 20][adr & MMU.MMU_MASK[ARMCPU_ARM7][adr >> 20]] = val;
 }
@@ -2576,6 +2602,8 @@ void FASTCALL _MMU_ARM7_write16(uint32_t adr, uint16_t val)
 		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0) = 0;
 #endif
 
+	sampleCache.notifyWrite(adr);
+
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM7][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM7][adr >> 20], val);
 }
@@ -2664,6 +2692,8 @@ void FASTCALL _MMU_ARM7_write32(uint32_t adr, uint32_t val)
 	}
 #endif
 
+	sampleCache.notifyWrite(adr);
+
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM7][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM7][adr >> 20], val);
 }
@@ -34,6 +34,8 @@
 #include "arm_jit.h"
 #endif
 
+#include "../spu/samplecache.h"
+
 #define ARMCPU_ARM7 1
 #define ARMCPU_ARM9 0
 #define ARMPROC (PROCNUM ? NDS_ARM7 : NDS_ARM9)
@@ -308,9 +310,9 @@ struct MMU_struct
 	uint8_t ARM9_ITCM[0x8000];
 	uint8_t ARM9_DTCM[0x4000];
 
-	//u8 MAIN_MEM[4*1024*1024]; // expanded from 4MB to 8MB to support debug consoles
-	//u8 MAIN_MEM[8*1024*1024]; // expanded from 8MB to 16MB to support dsi
-	uint8_t MAIN_MEM[16*1024*1024]; // expanded from 8MB to 16MB to support dsi
+	// 2SF only ever runs as a retail DS, so main memory stays at 4MB (DeSmuME grows this to 8MB for
+	// debug consoles and 16MB for the DSi, which made every reset clear four times as much memory)
+	uint8_t MAIN_MEM[4*1024*1024];
 	uint8_t ARM9_REG[0x1000000];
 	uint8_t ARM9_BIOS[0x8000];
 	uint8_t ARM9_VMEM[0x800];
@@ -546,10 +548,9 @@ uint32_t FASTCALL _MMU_ARM7_read32(uint32_t adr);
 
 extern uint32_t partie;
 
-extern uint32_t _MMU_MAIN_MEM_MASK;
-extern uint32_t _MMU_MAIN_MEM_MASK16;
-extern uint32_t _MMU_MAIN_MEM_MASK32;
-void SetupMMU(bool debugConsole, bool dsi);
+const uint32_t _MMU_MAIN_MEM_MASK = sizeof(MMU.MAIN_MEM) - 1;
+const uint32_t _MMU_MAIN_MEM_MASK16 = _MMU_MAIN_MEM_MASK & ~1;
+const uint32_t _MMU_MAIN_MEM_MASK32 = _MMU_MAIN_MEM_MASK & ~3;
 
 // ALERT!!!!!!!!!!!!!!
 // the following inline functions dont do the 0x0FFFFFFF mask.
@@ -704,6 +705,7 @@ inline void _MMU_write08(int PROCNUM, MMU_ACCESS_TYPE AT, uint32_t addr, uint8_t
 #ifdef HAVE_JIT
 		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK, 0) = 0;
 #endif
+		sampleCache.notifyWrite(addr);
 		T1WriteByte( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK, val);
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 1, val, LUAMEMHOOK_WRITE);
@@ -745,6 +747,7 @@ inline void _MMU_write16(int PROCNUM, MMU_ACCESS_TYPE AT, uint32_t addr, uint16_
 #ifdef HAVE_JIT
 		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK16, 0) = 0;
 #endif
+		sampleCache.notifyWrite(addr);
 		T1WriteWord( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK16, val);
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 2, val, LUAMEMHOOK_WRITE);
@@ -787,6 +790,7 @@ inline void _MMU_write32(int PROCNUM, MMU_ACCESS_TYPE AT, uint32_t addr, uint32_
 		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 0) = 0;
 		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 1) = 0;
 #endif
+		sampleCache.notifyWrite(addr);
 		T1WriteLong( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK32, val);
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 4, val, LUAMEMHOOK_WRITE);
@@ -39,8 +39,10 @@
 // obviously, these defines don't cover all the variables or features needed,
 // and in particular, DMA or code+data access bus contention is still missing.
 
-// disable this to prevent the advanced timing logic from ever running at all
-//#define ENABLE_ADVANCED_TIMING
+// disable this to prevent the advanced timing logic from ever running at all.
+// when enabled, it only runs with NDS_TIMING_PROFILE_CACHE, the other profiles stay on the
+// wait states of MMU_regionAccesstime.
+#define ENABLE_ADVANCED_TIMING
 
 #ifdef ENABLE_ADVANCED_TIMING
 // makes non-sequential accesses slower than sequential ones.
@@ -64,7 +66,7 @@
 inline bool USE_TIMING()
 {
 #ifdef ENABLE_ADVANCED_TIMING
-	return CommonSettings.advanced_timing;
+	return CommonSettings.timing_profile == NDS_TIMING_PROFILE_CACHE;
 #else
 	return false;
 #endif
@@ -180,7 +182,9 @@ public:
 		);
 
 #ifdef ACCOUNT_FOR_NON_SEQUENTIAL_ACCESS
-		this->m_lastAddress = address;
+		// only the advanced timing looks at it
+		if (TIMING)
+			this->m_lastAddress = address;
 #endif
 
 		return time;
@@ -214,6 +218,11 @@ struct MMU_struct_timing
 
 	template<int PROCNUM> FetchAccessUnit<PROCNUM, MMU_AT_CODE> &armCodeFetch();
 	template<int PROCNUM> FetchAccessUnit<PROCNUM, MMU_AT_DATA> &armDataFetch();
+
+	// what ARM9 CPU accesses of up to 16 bits and of 32 bits cost outside of the cache simulation,
+	// per memory region. MMU_Reset fills these in for CommonSettings.timing_profile, which keeps the
+	// choice of profile out of _MMU_accesstime.
+	uint8_t arm9Wait[2][0x100];
 };
 template<> inline FetchAccessUnit<0, MMU_AT_CODE> &MMU_struct_timing::armCodeFetch<0>() { return this->arm9codeFetch; }
 template<> inline FetchAccessUnit<1, MMU_AT_CODE> &MMU_struct_timing::armCodeFetch<1>() { return this->arm7codeFetch; }
@@ -222,16 +231,35 @@ template<> inline FetchAccessUnit<1, MMU_AT_DATA> &MMU_struct_timing::armDataFet
 
 extern MMU_struct_timing MMU_timing;
 
+// the wait states of a memory region, without any of the advanced timing.
+template<int PROCNUM, int READSIZE> inline uint32_t MMU_regionAccesstime(uint32_t addr)
+{
+	static const int MC = 1; // cached or tcm memory speed
+	static const int M32 = PROCNUM == ARMCPU_ARM9 ? 2 : 1; // access through 32-bit bus
+	static const int M16 = M32 * (READSIZE > 16 ? 2 : 1); // access through 16-bit bus
+	static const int MSLW = M16 * 8; // this needs tuning
+
+	static const TWaitState MMU_WAIT[] =
+	{
+		// ITCM, ITCM, MAIN, SWI, REG, VMEM, LCD, OAM,  ROM,  ROM,  RAM,   U,  U,  U,  U, BIOS
+#define X    MC,   MC,  M16, M32, M32,  M16, M16, M32, MSLW, MSLW, MSLW, M32,M32,M32,M32,  M32,
+		// duplicate it 16 times (this was somehow faster than using a mask of 0xF)
+		X X X X  X X X X  X X X X  X X X X
+#undef X
+	};
+
+	return MMU_WAIT[addr >> 24];
+}
+
 // calculates the time a single memory access takes,
 // in units of cycles of the current processor.
 // this function replaces what used to be MMU_WAIT16 and MMU_WAIT32.
 // this may have side effects, so don't call it more than necessary.
-template<int PROCNUM, MMU_ACCESS_TYPE AT, int READSIZE, MMU_ACCESS_DIRECTION DIRECTION, bool TIMING> inline uint32_t _MMU_accesstime(uint32_t addr, bool /*sequential*/)
+template<int PROCNUM, MMU_ACCESS_TYPE AT, int READSIZE, MMU_ACCESS_DIRECTION DIRECTION, bool TIMING> inline uint32_t _MMU_accesstime(uint32_t addr, bool sequential)
 {
 	static const int MC = 1; // cached or tcm memory speed
 	static const int M32 = PROCNUM == ARMCPU_ARM9 ? 2 : 1; // access through 32-bit bus
 	static const int M16 = M32 * (READSIZE > 16 ? 2 : 1); // access through 16-bit bus
-	static const int MSLW = M16 * 8; // this needs tuning
 
 	if (PROCNUM == ARMCPU_ARM9 && AT == MMU_AT_CODE && addr < 0x02000000)
 		return MC; // ITCM
@@ -272,16 +300,11 @@ template<int PROCNUM, MMU_ACCESS_TYPE AT, int READSIZE, MMU_ACCESS_DIRECTION DIR
 #endif
 	}
 
-	static const TWaitState MMU_WAIT[] =
-	{
-		// ITCM, ITCM, MAIN, SWI, REG, VMEM, LCD, OAM,  ROM,  ROM,  RAM,   U,  U,  U,  U, BIOS
-#define X    MC,   MC,  M16, M32, M32,  M16, M16, M32, MSLW, MSLW, MSLW, M32,M32,M32,M32,  M32,
-		// duplicate it 16 times (this was somehow faster than using a mask of 0xF)
-		X X X X  X X X X  X X X X  X X X X
-#undef X
-	};
-
-	uint32_t c = MMU_WAIT[addr >> 24];
+	uint32_t c;
+	if (!TIMING && PROCNUM == ARMCPU_ARM9 && AT != MMU_AT_DMA)
+		c = MMU_timing.arm9Wait[READSIZE > 16][addr >> 24];
+	else
+		c = MMU_regionAccesstime<PROCNUM, READSIZE>(addr);
 
 #ifdef ACCOUNT_FOR_NON_SEQUENTIAL_ACCESS
 	if (TIMING && !sequential)
@@ -307,10 +330,22 @@ template<int PROCNUM, int READSIZE, MMU_ACCESS_DIRECTION DIRECTION, bool TIMING>
 		return MMU_timing.armDataFetch<PROCNUM>().template Fetch<READSIZE, DIRECTION, false>(addr & (~((READSIZE >> 3) - 1)));
 }
 
+// the advanced timing only runs with NDS_TIMING_PROFILE_CACHE, so it is kept out of line
+// to leave the accesses of the other profiles as small as they were without it.
+template<int PROCNUM, int READSIZE, MMU_ACCESS_DIRECTION DIRECTION> NOINLINE uint32_t MMU_memAccessCyclesTimed(uint32_t addr)
+{
+	return MMU_memAccessCycles<PROCNUM, READSIZE, DIRECTION, true>(addr);
+}
+
+template<int PROCNUM, int READSIZE> NOINLINE uint32_t MMU_codeFetchCyclesTimed(uint32_t addr)
+{
+	return MMU_timing.armCodeFetch<PROCNUM>().template Fetch<READSIZE, MMU_AD_READ, true>(addr);
+}
+
 template<int PROCNUM, int READSIZE, MMU_ACCESS_DIRECTION DIRECTION> inline uint32_t MMU_memAccessCycles(uint32_t addr)
 {
 	if (USE_TIMING())
-		return MMU_memAccessCycles<PROCNUM, READSIZE, DIRECTION, true>(addr);
+		return MMU_memAccessCyclesTimed<PROCNUM, READSIZE, DIRECTION>(addr);
 	else
 		return MMU_memAccessCycles<PROCNUM, READSIZE, DIRECTION, false>(addr);
 }
@@ -321,7 +356,7 @@ template<int PROCNUM, int READSIZE, MMU_ACCESS_DIRECTION DIRECTION> inline uint3
 template<int PROCNUM, int READSIZE> inline uint32_t MMU_codeFetchCycles(uint32_t addr)
 {
 	if (USE_TIMING())
-		return MMU_timing.armCodeFetch<PROCNUM>().template Fetch<READSIZE, MMU_AD_READ, true>(addr & (~((READSIZE >> 3) - 1)));
+		return MMU_codeFetchCyclesTimed<PROCNUM, READSIZE>(addr & (~((READSIZE >> 3) - 1)));
 	else
 		return MMU_timing.armCodeFetch<PROCNUM>().template Fetch<READSIZE, MMU_AD_READ, false>(addr & (~((READSIZE >> 3) - 1)));
 }
@@ -349,12 +384,7 @@ template<int PROCNUM> inline uint32_t MMU_aluMemCycles(uint32_t aluCycles, uint3
 // this may have side effects, so don't call it more than necessary.
 template<int PROCNUM, int READSIZE, MMU_ACCESS_DIRECTION DIRECTION> inline uint32_t MMU_aluMemAccessCycles(uint32_t aluCycles, uint32_t addr)
 {
-	uint32_t memCycles;
-	if (USE_TIMING())
-		memCycles = MMU_memAccessCycles<PROCNUM, READSIZE, DIRECTION, true>(addr);
-	else
-		memCycles = MMU_memAccessCycles<PROCNUM, READSIZE, DIRECTION, false>(addr);
-	return MMU_aluMemCycles<PROCNUM>(aluCycles, memCycles);
+	return MMU_aluMemCycles<PROCNUM>(aluCycles, MMU_memAccessCycles<PROCNUM, READSIZE, DIRECTION>(addr));
 }
 
 // calculates the cycle contribution of FETCH + EXECUTE stages
@@ -163,8 +163,17 @@ struct TSequenceItem
 	uint32_t param;
 	bool enabled;
 
+	// time of the next event as last told to the sequencer, and where that put the item in its heap
+	uint64_t key;
+	unsigned heapIndex;
+
 	virtual ~TSequenceItem() { }
 
+	bool isEnabled() const
+	{
+		return this->enabled;
+	}
+
 	virtual bool isTriggered() const
 	{
 		return this->enabled && nds_timer >= this->timestamp;
@@ -274,7 +283,7 @@ struct TSequenceItem_divider : public TSequenceItem
 		return MMU.divRunning && nds_timer >= MMU.divCycles;
 	}
 
-	bool isEnabled()
+	bool isEnabled() const
 	{
 		return MMU.divRunning;
 	}
@@ -307,7 +316,7 @@ struct TSequenceItem_sqrtunit : public TSequenceItem
 		return MMU.sqrtRunning && nds_timer >= MMU.sqrtCycles;
 	}
 
-	bool isEnabled()
+	bool isEnabled() const
 	{
 		return MMU.sqrtRunning;
 	}
@@ -325,6 +334,77 @@ struct TSequenceItem_sqrtunit : public TSequenceItem
 	}
 };
 
+// Binary min-heap of sequencer items ordered by the time of their next event, so finding the
+// next work unit doesn't need to look at every item. Items that can't fire are keyed at ~0.
+class TSequenceHeap
+{
+	static const unsigned MaxItems = 19;
+
+	TSequenceItem *items[MaxItems];
+	unsigned count;
+
+	void place(TSequenceItem *item, unsigned i)
+	{
+		this->items[i] = item;
+		item->heapIndex = i;
+	}
+
+	void siftUp(unsigned i)
+	{
+		auto item = this->items[i];
+		while (i)
+		{
+			unsigned parent = (i - 1) >> 1;
+			if (this->items[parent]->key <= item->key)
+				break;
+			this->place(this->items[parent], i);
+			i = parent;
+		}
+		this->place(item, i);
+	}
+
+	void siftDown(unsigned i)
+	{
+		auto item = this->items[i];
+		for (;;)
+		{
+			unsigned child = 2 * i + 1;
+			if (child >= this->count)
+				break;
+			if (child + 1 < this->count && this->items[child + 1]->key < this->items[child]->key)
+				++child;
+			if (item->key <= this->items[child]->key)
+				break;
+			this->place(this->items[child], i);
+			i = child;
+		}
+		this->place(item, i);
+	}
+public:
+	TSequenceHeap() : count(0) { }
+
+	void add(TSequenceItem *item)
+	{
+		item->key = ~0ULL;
+		this->place(item, this->count++);
+	}
+
+	void update(TSequenceItem *item, uint64_t key)
+	{
+		uint64_t old = item->key;
+		item->key = key;
+		if (key < old)
+			this->siftUp(item->heapIndex);
+		else if (key > old)
+			this->siftDown(item->heapIndex);
+	}
+
+	uint64_t next() const
+	{
+		return this->items[0]->key;
+	}
+};
+
 static struct Sequencer
 {
 	bool nds_vblankEnded;
@@ -342,6 +422,15 @@ static struct Sequencer
 	TSequenceItem_Timer<0, 2> timer_0_2; TSequenceItem_Timer<0, 3> timer_0_3;
 	TSequenceItem_Timer<1, 0> timer_1_0; TSequenceItem_Timer<1, 1> timer_1_1;
 	TSequenceItem_Timer<1, 2> timer_1_2; TSequenceItem_Timer<1, 3> timer_1_3;
+	TSequenceHeap heap;
+
+	Sequencer();
+
+	// must be called whenever something changes when or whether an item fires
+	template<typename T> void update(T &item)
+	{
+		this->heap.update(&item, item.isEnabled() ? item.next() : ~0ULL);
+	}
 
 	void init();
 
@@ -351,7 +440,9 @@ static struct Sequencer
 
 void NDS_RescheduleTimers()
 {
-#define check(X, Y) sequencer.timer_##X##_##Y .schedule();
+#define check(X, Y) \
+	sequencer.timer_##X##_##Y .schedule(); \
+	sequencer.update(sequencer.timer_##X##_##Y);
 	check(0, 0); check(0, 1); check(0, 2); check(0, 3);
 	check(1, 0); check(1, 1); check(1, 2); check(1, 3);
 #undef check
@@ -361,7 +452,23 @@ void NDS_RescheduleTimers()
 
 void NDS_RescheduleDMA()
 {
-	//TBD
+#define check(X, Y) sequencer.update(sequencer.dma_##X##_##Y);
+	check(0, 0); check(0, 1); check(0, 2); check(0, 3);
+	check(1, 0); check(1, 1); check(1, 2); check(1, 3);
+#undef check
+
+	NDS_Reschedule();
+}
+
+void NDS_RescheduleDivider()
+{
+	sequencer.update(sequencer.divider);
+	NDS_Reschedule();
+}
+
+void NDS_RescheduleSqrt()
+{
+	sequencer.update(sequencer.sqrtunit);
 	NDS_Reschedule();
 }
 
@@ -384,10 +491,36 @@ static void initSchedule()
 //const uint64_t kWifiCycles = 34*2;
 //(this isn't very precise. I don't think it needs to be)
 
+Sequencer::Sequencer()
+{
+	// the MMU is reset in place, so the controllers never move
+	this->dma_0_0.controller = &MMU_new.dma[0][0];
+	this->dma_0_1.controller = &MMU_new.dma[0][1];
+	this->dma_0_2.controller = &MMU_new.dma[0][2];
+	this->dma_0_3.controller = &MMU_new.dma[0][3];
+	this->dma_1_0.controller = &MMU_new.dma[1][0];
+	this->dma_1_1.controller = &MMU_new.dma[1][1];
+	this->dma_1_2.controller = &MMU_new.dma[1][2];
+	this->dma_1_3.controller = &MMU_new.dma[1][3];
+
+	// wifi and gxfifo never fire, so they stay out of the heap
+	this->heap.add(&this->dispcnt);
+	this->heap.add(&this->divider);
+	this->heap.add(&this->sqrtunit);
+#define add(X, Y) \
+	this->heap.add(&this->dma_##X##_##Y); \
+	this->heap.add(&this->timer_##X##_##Y);
+	add(0, 0); add(0, 1); add(0, 2); add(0, 3);
+	add(1, 0); add(1, 1); add(1, 2); add(1, 3);
+#undef add
+}
+
 void Sequencer::init()
 {
 	NDS_RescheduleTimers();
 	NDS_RescheduleDMA();
+	NDS_RescheduleDivider();
+	NDS_RescheduleSqrt();
 
 	this->reschedule = false;
 	nds_timer = 0;
@@ -397,15 +530,7 @@ void Sequencer::init()
 	this->dispcnt.enabled = true;
 	this->dispcnt.param = ESI_DISPCNT_HStart;
 	this->dispcnt.timestamp = 0;
-
-	this->dma_0_0.controller = &MMU_new.dma[0][0];
-	this->dma_0_1.controller = &MMU_new.dma[0][1];
-	this->dma_0_2.controller = &MMU_new.dma[0][2];
-	this->dma_0_3.controller = &MMU_new.dma[0][3];
-	this->dma_1_0.controller = &MMU_new.dma[1][0];
-	this->dma_1_1.controller = &MMU_new.dma[1][1];
-	this->dma_1_2.controller = &MMU_new.dma[1][2];
-	this->dma_1_3.controller = &MMU_new.dma[1][3];
+	this->update(this->dispcnt);
 }
 
 static void execHardware_hblank()
@@ -578,57 +703,17 @@ void NDS_Reschedule()
 	sequencer.reschedule = true;
 }
 
-static inline uint64_t _fast_min(uint64_t a, uint64_t b)
-{
-	// you might find that this is faster on a 64bit system; someone should try it
-	// http://aggregate.org/MAGIC/#Integer%20Selection
-	//uint64_t ret = (((((s64)(a-b)) >> (64-1)) & (a^b)) ^ b);
-	//assert(ret==min(a,b));
-	//return ret;
-
-	// but this ends up being the fastest on 32bits
-	return a<b?a:b;
-
-	// just for the record, I tried to do the 64bit math on a 32bit proc
-	// using sse2 and it was really slow
-	//__m128i __a; __a.m128i_u64[0] = a;
-	//__m128i __b; __b.m128i_u64[0] = b;
-	//__m128i xorval = _mm_xor_si128(__a,__b);
-	//__m128i temp = _mm_sub_epi64(__a,__b);
-	//temp.m128i_i64[0] >>= 63; //no 64bit shra in sse2, what a disappointment
-	//temp = _mm_and_si128(temp,xorval);
-	//temp = _mm_xor_si128(temp,__b);
-	//return temp.m128i_u64[0];
-}
-
 uint64_t Sequencer::findNext()
 {
-	// this one is always enabled so dont bother to check it
-	uint64_t next = this->dispcnt.next();
-
-	if (this->divider.isEnabled())
-		next = _fast_min(next, this->divider.next());
-	if (this->sqrtunit.isEnabled())
-		next = _fast_min(next, this->sqrtunit.next());
-
-#define test(X, Y) \
-	if (this->dma_##X##_##Y .isEnabled()) \
-		next = _fast_min(next, this->dma_##X##_##Y .next());
-	test(0, 0); test(0, 1); test(0, 2); test(0, 3);
-	test(1, 0); test(1, 1); test(1, 2); test(1, 3);
-#undef test
-#define test(X, Y) \
-	if (this->timer_##X##_##Y .enabled) \
-		next = _fast_min(next, this->timer_##X##_##Y .next());
-	test(0, 0); test(0, 1); test(0, 2); test(0, 3);
-	test(1, 0); test(1, 1); test(1, 2); test(1, 3);
-#undef test
-
-	return next;
+	return this->heap.next();
 }
 
 void Sequencer::execHardware()
 {
+	// nothing is due before the earliest item in the heap
+	if (nds_timer < this->heap.next())
+		return;
+
 	if (this->dispcnt.isTriggered())
 	{
 		switch (this->dispcnt.param)
@@ -660,22 +745,35 @@ void Sequencer::execHardware()
 				this->dispcnt.timestamp += 1056;
 				this->dispcnt.param = ESI_DISPCNT_HStart;
 		}
+		this->update(this->dispcnt);
 	}
 
 	if (this->divider.isTriggered())
+	{
 		this->divider.exec();
+		this->update(this->divider);
+	}
 	if (this->sqrtunit.isTriggered())
+	{
 		this->sqrtunit.exec();
+		this->update(this->sqrtunit);
+	}
 
 #define test(X, Y) \
 	if (this->dma_##X##_##Y .isTriggered()) \
-		this->dma_##X##_##Y .exec();
+	{ \
+		this->dma_##X##_##Y .exec(); \
+		this->update(this->dma_##X##_##Y); \
+	}
 	test(0, 0); test(0, 1); test(0, 2); test(0, 3);
 	test(1, 0); test(1, 1); test(1, 2); test(1, 3);
 #undef test
 #define test(X, Y) \
 	if (this->timer_##X##_##Y .enabled && this->timer_##X##_##Y .isTriggered()) \
-		this->timer_##X##_##Y .exec();
+	{ \
+		this->timer_##X##_##Y .exec(); \
+		this->update(this->timer_##X##_##Y); \
+	}
 	test(0, 0); test(0, 1); test(0, 2); test(0, 3);
 	test(1, 0); test(1, 1); test(1, 2); test(1, 3);
 #undef test
@@ -684,7 +782,6 @@ void Sequencer::execHardware()
 void execHardware_interrupts();
 
 // these have not been tuned very well yet.
-static const int kMaxWork = 4000;
 static const int kIrqWait = 4000;
 
 template<bool doarm9, bool doarm7> static inline int32_t minarmtime(int32_t arm9, int32_t arm7)
@@ -700,6 +797,18 @@ template<bool doarm9, bool doarm7> static inline int32_t minarmtime(int32_t arm9
 		return arm7;
 }
 
+#ifdef HAVE_JIT
+// A CPU in an idle loop rereads the same values until the other CPU or a hardware event changes
+// them, so run all the passes that would happen before limit at once. Each pass takes the same
+// number of cycles, and the CPU ends up exactly where it would have after the last one.
+static inline int32_t skipIdleLoop(int32_t time, int32_t pass, int32_t limit)
+{
+	if (time >= limit || pass <= 0)
+		return time;
+	return time + (limit - time + pass - 1) / pass * pass;
+}
+#endif
+
 #ifdef HAVE_JIT
 template<bool doarm9, bool doarm7, bool jit>
 #else
@@ -708,6 +817,13 @@ template<bool doarm9, bool doarm7>
 static std::pair<int32_t, int32_t> armInnerLoop(uint64_t nds_timer_base, int32_t s32next, int32_t arm9, int32_t arm7)
 {
 	int32_t timer = minarmtime<doarm9, doarm7>(arm9, arm7);
+#ifdef HAVE_JIT
+	// whether the CPU's last block was an idle loop that nothing has disturbed since
+	bool idle9 = false, idle7 = false;
+	// the parked loop each CPU is in, if any, and how long one pass of it takes
+	uintptr_t park9 = 0, park7 = 0;
+	int32_t pass9 = 0, pass7 = 0;
+#endif
 	while (timer < s32next && !sequencer.reschedule && execute)
 	{
 		if (doarm9 && (!doarm7 || arm9 <= timer))
@@ -715,7 +831,36 @@ static std::pair<int32_t, int32_t> armInnerLoop(uint64_t nds_timer_base, int32_t
 			if (!NDS_ARM9.waitIRQ && !nds.freezeBus)
 			{
 #ifdef HAVE_JIT
-				arm9 += armcpu_exec<ARMCPU_ARM9, jit>();
+				int32_t pass;
+				if (jit && park9 && JIT_COMPILED_FUNC(NDS_ARM9.instruct_adr, ARMCPU_ARM9) == park9)
+				{
+					// nothing the loop reads can have changed, so another pass would only take the same time
+					pass = pass9;
+					idle9 = true;
+				}
+				else
+				{
+					if (jit)
+						arm_jit_set_budget<ARMCPU_ARM9>(nds_timer_base, arm9, doarm7 ? std::min(arm7, s32next) : s32next);
+					pass = armcpu_exec<ARMCPU_ARM9, jit>();
+					if (jit)
+					{
+						idle9 = JIT_loop.idle;
+						park9 = JIT_loop.parked ? JIT_COMPILED_FUNC(NDS_ARM9.instruct_adr, ARMCPU_ARM9) : 0;
+						pass9 = pass;
+					}
+				}
+				arm9 += pass;
+				if (jit)
+				{
+					// the ARM7 may still change what the loop is waiting on, unless it's idle itself
+					if (!idle9)
+						idle7 = false;
+					else if (doarm7 && !NDS_ARM7.waitIRQ && !idle7)
+						arm9 = skipIdleLoop(arm9, pass, std::min(arm7, s32next));
+					else
+						arm9 = skipIdleLoop(arm9, pass, s32next);
+				}
 #else
 				arm9 += armcpu_exec<ARMCPU_ARM9>();
 #endif
@@ -728,7 +873,34 @@ static std::pair<int32_t, int32_t> armInnerLoop(uint64_t nds_timer_base, int32_t
 			if (!NDS_ARM7.waitIRQ && !nds.freezeBus)
 			{
 #ifdef HAVE_JIT
-				arm7 += armcpu_exec<ARMCPU_ARM7, jit>() << 1;
+				int32_t pass;
+				if (jit && park7 && JIT_COMPILED_FUNC(NDS_ARM7.instruct_adr, ARMCPU_ARM7) == park7)
+				{
+					pass = pass7;
+					idle7 = true;
+				}
+				else
+				{
+					if (jit)
+						arm_jit_set_budget<ARMCPU_ARM7>(nds_timer_base, arm7, doarm9 ? std::min(arm9, s32next) : s32next);
+					pass = armcpu_exec<ARMCPU_ARM7, jit>() << 1;
+					if (jit)
+					{
+						idle7 = JIT_loop.idle;
+						park7 = JIT_loop.parked ? JIT_COMPILED_FUNC(NDS_ARM7.instruct_adr, ARMCPU_ARM7) : 0;
+						pass7 = pass;
+					}
+				}
+				arm7 += pass;
+				if (jit)
+				{
+					if (!idle7)
+						idle9 = false;
+					else if (doarm9 && !NDS_ARM9.waitIRQ && !idle9)
+						arm7 = skipIdleLoop(arm7, pass, std::min(arm9, s32next));
+					else
+						arm7 = skipIdleLoop(arm7, pass, s32next);
+				}
 #else
 				arm7 += armcpu_exec<ARMCPU_ARM7>() << 1;
 #endif
@@ -786,8 +958,9 @@ template<bool FORCE> void NDS_exec(int32_t)
 			execHardware_interrupts();
 
 			// find next work unit:
+			// a CPU waiting for an irq already gets another look every kIrqWait cycles,
+			// and everything else that can interrupt the unit goes through NDS_Reschedule
 			uint64_t next = sequencer.findNext();
-			next = std::min(next, nds_timer + kMaxWork); // lets set an upper limit for now
 
 			//fprintf(stderr, "%d\n", next - nds_timer);
 
@@ -799,10 +972,19 @@ template<bool FORCE> void NDS_exec(int32_t)
 			int32_t arm7 = (nds_arm7_timer - nds_timer) & 0xFFFFFFFF;
 			int32_t s32next = (next - nds_timer) & 0xFFFFFFFF;
 
+			// an ARM9 waiting for an irq can't wake up before the next execHardware_interrupts,
+			// so leave it out of the work unit altogether (its timer gets caught up below)
+			std::pair<int32_t, int32_t> arm9arm7;
 #ifdef HAVE_JIT
-			auto arm9arm7 = CommonSettings.use_jit ? armInnerLoop<true, true, true>(nds_timer_base, s32next, arm9, arm7) : armInnerLoop<true, true, false>(nds_timer_base, s32next, arm9, arm7);
+			if (NDS_ARM9.waitIRQ)
+				arm9arm7 = CommonSettings.use_jit ? armInnerLoop<false, true, true>(nds_timer_base, s32next, arm9, arm7) : armInnerLoop<false, true, false>(nds_timer_base, s32next, arm9, arm7);
+			else
+				arm9arm7 = CommonSettings.use_jit ? armInnerLoop<true, true, true>(nds_timer_base, s32next, arm9, arm7) : armInnerLoop<true, true, false>(nds_timer_base, s32next, arm9, arm7);
 #else
-			auto arm9arm7 = armInnerLoop<true, true>(nds_timer_base, s32next, arm9, arm7);
+			if (NDS_ARM9.waitIRQ)
+				arm9arm7 = armInnerLoop<false, true>(nds_timer_base, s32next, arm9, arm7);
+			else
+				arm9arm7 = armInnerLoop<true, true>(nds_timer_base, s32next, arm9, arm7);
 #endif
 
 			arm9 = arm9arm7.first;
@@ -1025,6 +1207,7 @@ void NDS_Reset()
 
 #ifdef HAVE_JIT
 	arm_jit_reset(CommonSettings.use_jit);
+	JIT_loop.reschedule = &sequencer.reschedule;
 #endif
 
 	PrepareBiosARM7();
@@ -1137,7 +1320,6 @@ void NDS_Reset()
 
 	memset(nds.timerCycle, 0, sizeof(uint64_t) * 8);
 	nds.old = 0;
-	SetupMMU(false, nds.Is_DSI());
 
 	_MMU_write16<ARMCPU_ARM9>(REG_KEYINPUT, 0x3FF);
 	_MMU_write16<ARMCPU_ARM7>(REG_KEYINPUT, 0x3FF);
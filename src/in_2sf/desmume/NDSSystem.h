@@ -114,6 +114,8 @@ extern uint64_t nds_timer;
 void NDS_Reschedule();
 void NDS_RescheduleDMA();
 void NDS_RescheduleTimers();
+void NDS_RescheduleDivider();
+void NDS_RescheduleSqrt();
 
 enum NDS_CONSOLE_TYPE
 {
@@ -123,6 +125,14 @@ enum NDS_CONSOLE_TYPE
 	NDS_CONSOLE_TYPE_DSI
 };
 
+// How many cycles memory accesses cost, see MMU_timing.h
+enum NDS_TIMING_PROFILE
+{
+	NDS_TIMING_PROFILE_CACHE, // DeSmuME's advanced timing, which simulates ARM9 cache hits and misses
+	NDS_TIMING_PROFILE_REGION, // a wait state table indexed by memory region
+	NDS_TIMING_PROFILE_FIXED // the region table, except that every ARM9 access costs a single cycle
+};
+
 struct NDSSystem
 {
 	int32_t cycles;
@@ -282,7 +292,7 @@ template<bool FORCE> void NDS_exec(int32_t nb = 560190 << 1);
 
 extern struct TCommonSettings
 {
-	TCommonSettings() : UseExtBIOS(false), SWIFromBIOS(false), PatchSWI3(false), UseExtFirmware(false), BootFromFirmware(false), ConsoleType(NDS_CONSOLE_TYPE_FAT), rigorous_timing(false), advanced_timing(true),
+	TCommonSettings() : UseExtBIOS(false), SWIFromBIOS(false), PatchSWI3(false), UseExtFirmware(false), BootFromFirmware(false), ConsoleType(NDS_CONSOLE_TYPE_FAT), rigorous_timing(false), timing_profile(NDS_TIMING_PROFILE_REGION), timing_validate(false), jit_profile(false),
 		spuInterpolationMode(SPUInterpolation_Linear), manualBackupType(0), spu_captureMuted(false), spu_advanced(false)
 	{
 		strcpy(this->ARM9BIOS, "biosnds9.bin");
@@ -343,10 +353,14 @@ extern struct TCommonSettings
 
 	bool rigorous_timing;
 
-	bool advanced_timing;
+	NDS_TIMING_PROFILE timing_profile;
+	// checks the profile against the cache simulation when a 2SF gets loaded, see XSFPlayer_2SF
+	bool timing_validate;
 
 	bool use_jit;
 	uint32_t jit_max_block_size;
+	// see arm_jit_profile
+	bool jit_profile;
 
 	SPUInterpolationMode spuInterpolationMode;
 
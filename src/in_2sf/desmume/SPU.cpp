@@ -31,6 +31,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <queue>
 #include <vector>
 
@@ -54,7 +55,6 @@ static inline s8 read_s8(u32 addr) { return (s8)_MMU_read08<ARMCPU_ARM7,MMU_AT_D
 SPU_struct *SPU_core = 0;
 int SPU_currentCoreNum = SNDCORE_DUMMY;
 static int volume = 100;
-static SampleCache sampleCache;
 
 static size_t buffersize = 0;
 static ESynchMode synchmode = ESynchMode_Synchronous;
@@ -65,6 +65,12 @@ static int SNDCoreId=-1;
 static SoundInterface_struct *SNDCore=NULL;
 extern SoundInterface_struct *SNDCoreList[];
 
+// see SPU_SetSink
+static bool sinkEnabled = false;
+static s16 *sinkBuffer = NULL;
+static u32 sinkSpace = 0;
+static std::vector<s16> sinkCarry;
+
 static const int format_shift[] = { 2, 1, 3, 0 };
 static const u8 volume_shift[] = { 0, 1, 2, 4 };
 
@@ -241,6 +247,7 @@ void SPU_Reset(void)
   int i;
 
   SPU_core->reset();
+  sampleCache.clear();
 
   //zero - 09-apr-2010: this concerns me, regarding savestate synch.
   //After 0.9.6, lets experiment with removing it and just properly zapping the spu instead
@@ -292,6 +299,11 @@ void SPU_DeInit(void)
     SNDCore->DeInit();
   SNDCore = 0;
 
+  sinkEnabled = false;
+  sinkBuffer = NULL;
+  sinkSpace = 0;
+  sinkCarry.clear();
+
   delete SPU_core; SPU_core=0;
 }
 
@@ -333,6 +345,7 @@ void SPU_struct::KeyOn(int channel)
 {
   channel_struct &thischan = channels[channel];
   thischan.status = CHANSTAT_PLAY;
+  thischan.sample = NULL;
 
   thischan.totlength = thischan.length + thischan.loopstart;
   adjust_channel_timer(&thischan);
@@ -670,18 +683,18 @@ void SPU_struct::WriteByte(u32 addr, u8 val)
                 thischan.keyon = (val >> 7) & 0x01;
                 KeyProbe(chan_num);
                 break;
-      case 0x4: thischan.addr &= 0xFFFFFF00; thischan.addr |= (val & 0xFC); break;
-      case 0x5: thischan.addr &= 0xFFFF00FF; thischan.addr |= (val << 8); break;
-      case 0x6: thischan.addr &= 0xFF00FFFF; thischan.addr |= (val << 16); break;
-      case 0x7: thischan.addr &= 0x00FFFFFF; thischan.addr |= ((val&7) << 24); break; //only 27 bits of this register are used
+      case 0x4: thischan.addr &= 0xFFFFFF00; thischan.addr |= (val & 0xFC); thischan.sample = NULL; break;
+      case 0x5: thischan.addr &= 0xFFFF00FF; thischan.addr |= (val << 8); thischan.sample = NULL; break;
+      case 0x6: thischan.addr &= 0xFF00FFFF; thischan.addr |= (val << 16); thischan.sample = NULL; break;
+      case 0x7: thischan.addr &= 0x00FFFFFF; thischan.addr |= ((val&7) << 24); thischan.sample = NULL; break; //only 27 bits of this register are used
       case 0x8: thischan.timer &= 0xFF00; thischan.timer |= (val << 0); adjust_channel_timer(&thischan); break;
       case 0x9: thischan.timer &= 0x00FF; thischan.timer |= (val << 8); adjust_channel_timer(&thischan); break;
 
-      case 0xA: thischan.loopstart &= 0xFF00; thischan.loopstart |= (val << 0); break;
-      case 0xB: thischan.loopstart &= 0x00FF; thischan.loopstart |= (val << 8); break;
-      case 0xC: thischan.length &= 0xFFFFFF00; thischan.length |= (val << 0); break;
-      case 0xD: thischan.length &= 0xFFFF00FF; thischan.length |= (val << 8); break;
-      case 0xE: thischan.length &= 0xFF00FFFF; thischan.length |= ((val & 0x3F) << 16); //only 22 bits of this register are used
+      case 0xA: thischan.loopstart &= 0xFF00; thischan.loopstart |= (val << 0); thischan.sample = NULL; break;
+      case 0xB: thischan.loopstart &= 0x00FF; thischan.loopstart |= (val << 8); thischan.sample = NULL; break;
+      case 0xC: thischan.length &= 0xFFFFFF00; thischan.length |= (val << 0); thischan.sample = NULL; break;
+      case 0xD: thischan.length &= 0xFFFF00FF; thischan.length |= (val << 8); thischan.sample = NULL; break;
+      case 0xE: thischan.length &= 0xFF00FFFF; thischan.length |= ((val & 0x3F) << 16); thischan.sample = NULL; //only 22 bits of this register are used
       case 0xF: break;
 
     } //switch on individual channel regs
@@ -764,12 +777,12 @@ void SPU_struct::WriteWord(u32 addr, u16 val)
         thischan.keyon = (val >> 15) & 0x1;
         KeyProbe(chan_num);
         break;
-      case 0x4: thischan.addr &= 0xFFFF0000; thischan.addr |= (val & 0xFFFC); break;
-      case 0x6: thischan.addr &= 0x0000FFFF; thischan.addr |= ((val & 0x07FF) << 16); break;
+      case 0x4: thischan.addr &= 0xFFFF0000; thischan.addr |= (val & 0xFFFC); thischan.sample = NULL; break;
+      case 0x6: thischan.addr &= 0x0000FFFF; thischan.addr |= ((val & 0x07FF) << 16); thischan.sample = NULL; break;
       case 0x8: thischan.timer = val; adjust_channel_timer(&thischan); break;
-      case 0xA: thischan.loopstart = val; break;
-      case 0xC: thischan.length &= 0xFFFF0000; thischan.length |= (val << 0); break;
-      case 0xE: thischan.length &= 0x0000FFFF; thischan.length |= ((val & 0x003F) << 16); break;
+      case 0xA: thischan.loopstart = val; thischan.sample = NULL; break;
+      case 0xC: thischan.length &= 0xFFFF0000; thischan.length |= (val << 0); thischan.sample = NULL; break;
+      case 0xE: thischan.length &= 0x0000FFFF; thischan.length |= ((val & 0x003F) << 16); thischan.sample = NULL; break;
     } //switch on individual channel regs
     return;
   }
@@ -848,14 +861,15 @@ void SPU_struct::WriteLong(u32 addr, u32 val)
         KeyProbe(chan_num);
         break;
 
-      case 0x4: thischan.addr = (val & 0x07FFFFFC); break;
+      case 0x4: thischan.addr = (val & 0x07FFFFFC); thischan.sample = NULL; break;
       case 0x8:
                 thischan.timer = (val & 0xFFFF);
                 thischan.loopstart = ((val >> 16) & 0xFFFF);
+                thischan.sample = NULL;
                 adjust_channel_timer(&thischan);
                 break;
 
-      case 0xC: thischan.length = (val & 0x003FFFFF); break; //only 22 bits of this register are used
+      case 0xC: thischan.length = (val & 0x003FFFFF); thischan.sample = NULL; break; //only 22 bits of this register are used
     } //switch on individual channel regs
     return;
   }
@@ -910,6 +924,42 @@ void SPU_struct::WriteLong(u32 addr, u32 val)
 
 //////////////////////////////////////////////////////////////////////////////
 
+//the noise generator is a 15-bit LFSR, which visits every nonzero state once
+//in 32767 steps. numbering the states by their place in that period turns
+//any number of elapsed ticks into a table lookup.
+static struct PSGNoisePeriod
+{
+  static const u32 LENGTH = 0x7FFF;
+
+  u16 state[LENGTH]; //state after n steps from the key on state
+  u16 step[0x8000];  //how many steps from the key on state each state is
+
+  PSGNoisePeriod()
+  {
+    u16 x = 0x7FFF;
+    step[0] = 0;
+    for(u32 i = 0; i < LENGTH; i++)
+    {
+      state[i] = x;
+      step[x] = i;
+      if(x & 0x1)
+        x = (x >> 1) ^ 0x6000;
+      else
+        x >>= 1;
+    }
+  }
+} psgnoise;
+
+//how many steps of the duty cycle from phase on stay at the same level
+static FORCEINLINE u32 WaveDutyRun(u8 duty, u32 phase)
+{
+  const s16 level = wavedutytbl[duty][phase & 0x7];
+  u32 run = 1;
+  while(run < 8 && wavedutytbl[duty][(phase + run) & 0x7] == level)
+    run++;
+  return run;
+}
+
 static FORCEINLINE void FetchPSGData(channel_struct *chan, s32 *data)
 {
   if (chan->sampcnt < 0)
@@ -935,18 +985,13 @@ static FORCEINLINE void FetchPSGData(channel_struct *chan, s32 *data)
     }
 
     u32 max = sputrunc(chan->sampcnt);
-    for(u32 i = chan->lastsampcnt; i < max; i++)
+    if(max > chan->lastsampcnt)
     {
-      if(chan->x & 0x1)
-      {
-        chan->x = (chan->x >> 1) ^ 0x6000;
-        chan->psgnoise_last = -0x7FFF;
-      }
-      else
-      {
-        chan->x >>= 1;
-        chan->psgnoise_last = 0x7FFF;
-      }
+      //jump straight to where the generator would be after stepping once per elapsed tick
+      u32 pos = (psgnoise.step[chan->x] + (max - chan->lastsampcnt) % PSGNoisePeriod::LENGTH) % PSGNoisePeriod::LENGTH;
+      chan->x = psgnoise.state[pos];
+      pos = (pos == 0 ? PSGNoisePeriod::LENGTH : pos) - 1;
+      chan->psgnoise_last = (psgnoise.state[pos] & 0x1) ? -0x7FFF : 0x7FFF;
     }
 
     chan->lastsampcnt = sputrunc(chan->sampcnt);
@@ -1053,59 +1098,192 @@ template<int CHANNELS> FORCEINLINE static void SPU_Mix(SPU_struct* SPU, channel_
   SPU->lastdata = data;
 }
 
-//WORK
-  template<int FORMAT, int CHANNELS>
-FORCEINLINE static void ____SPU_ChanUpdate(SPU_struct* const SPU, channel_struct* const chan)
+template<int FORMAT> FORCEINLINE static void SPU_ChanAdvance(SPU_struct* SPU, channel_struct *chan)
 {
-  for (; SPU->bufpos < SPU->buflength; SPU->bufpos++)
+  switch(FORMAT) {
+    case 0: case 1: TestForLoop<FORMAT>(SPU, chan); break;
+    case 2: TestForLoop2(SPU, chan); break;
+    case 3: chan->sampcnt += chan->sampinc; break;
+  }
+}
+
+//adds one level to a run of output samples, working out volume and pan only once
+template<int CHANNELS> FORCEINLINE static void SPU_MixRun(SPU_struct* SPU, channel_struct *chan, s32 data, int start, int end)
+{
+  const s32 vol = spumuldiv7(data, chan->vol) >> volume_shift[chan->volumeDiv];
+  const s32 left = (CHANNELS == 1) ? spumuldiv7(vol, 127 - chan->pan) : vol;
+  const s32 right = (CHANNELS == 1) ? spumuldiv7(vol, chan->pan) : vol;
+  for (int i = start; i < end; i++)
+  {
+    if (CHANNELS != 2) SPU->sndbuf[i<<1] += left;
+    if (CHANNELS != 0) SPU->sndbuf[(i<<1)+1] += right;
+  }
+  SPU->lastdata = data;
+}
+
+//PSG and noise channels only change level at duty cycle edges and noise ticks,
+//so they are generated as runs of one level and each run is mixed in one go.
+//sampcnt is still stepped once per output sample, so the edges land where they did.
+template<int CHANNELS>
+FORCEINLINE static void ____SPU_ChanUpdatePSG(SPU_struct* const SPU, channel_struct* const chan)
+{
+  while (SPU->bufpos < SPU->buflength)
   {
-    if(CHANNELS != -1)
+    const int start = SPU->bufpos;
+    s32 data;
+    FetchPSGData(chan, &data);
+
+    if (chan->sampcnt < 0)
     {
-      s32 data;
-      if (chan->sampcnt < 0) {
-        data = 0;
-      } else if (FORMAT == 3) {
-        FetchPSGData(chan, &data);
-      } else {
-        const SampleData& sample = sampleCache.getSample(chan->addr, chan->loopstart, chan->length, SampleData::Format(FORMAT));
-        data = sample.sampleAt(chan->sampcnt, IInterpolator::allInterpolators[CommonSettings.spuInterpolationMode]);
-      }
-      SPU_Mix<CHANNELS>(SPU, chan, data);
+      do chan->sampcnt += chan->sampinc;
+      while (++SPU->bufpos < SPU->buflength && chan->sampcnt < 0);
+    }
+    else if (chan->num < 8)
+    {
+      do chan->sampcnt += chan->sampinc;
+      while (++SPU->bufpos < SPU->buflength);
+    }
+    else if (chan->num < 14)
+    {
+      const u32 phase = sputrunc(chan->sampcnt);
+      const u32 run = WaveDutyRun(chan->waveduty, phase);
+      do chan->sampcnt += chan->sampinc;
+      while (++SPU->bufpos < SPU->buflength && sputrunc(chan->sampcnt) - phase < run);
+    }
+    else
+    {
+      do chan->sampcnt += chan->sampinc;
+      while (++SPU->bufpos < SPU->buflength && sputrunc(chan->sampcnt) == chan->lastsampcnt);
     }
 
-    switch(FORMAT) {
-      case 0: case 1: TestForLoop<FORMAT>(SPU, chan); break;
-      case 2: TestForLoop2(SPU, chan); break;
-      case 3: chan->sampcnt += chan->sampinc; break;
+    SPU_MixRun<CHANNELS>(SPU, chan, data, start, SPU->bufpos);
+  }
+}
+
+//sampled channels are interpolated a run at a time. sampcnt is still stepped and
+//looped one sample at a time exactly as before; each read position is just noted
+//down in 32.32 fixed point so the interpolator can handle the whole run at once.
+  template<int FORMAT, int CHANNELS, typename INTERPOLATOR>
+FORCEINLINE static void ____SPU_ChanUpdateRuns(SPU_struct* const SPU, channel_struct* const chan)
+{
+  InterpolatorRun run;
+  s32 data[InterpolatorRun::maxLength];
+
+  while (SPU->bufpos < SPU->buflength)
+  {
+    if (chan->sampcnt < 0)
+    {
+      SPU_Mix<CHANNELS>(SPU, chan, 0);
+      SPU_ChanAdvance<FORMAT>(SPU, chan);
+      SPU->bufpos++;
+      continue;
     }
+
+    if (!chan->sample)
+      chan->sample = &sampleCache.getSample(chan->addr, chan->loopstart, chan->length, SampleData::Format(FORMAT));
+
+    const int start = SPU->bufpos;
+    run.length = 0;
+    do
+    {
+      const s64 pos = (s64)(chan->sampcnt * 4294967296.0);
+      run.index[run.length] = (u32)(pos >> 32);
+      run.frac[run.length] = (u32)pos;
+      run.time[run.length] = chan->sampcnt;
+      run.length++;
+      SPU_ChanAdvance<FORMAT>(SPU, chan);
+    } while (++SPU->bufpos < SPU->buflength && run.length < InterpolatorRun::maxLength && chan->sampcnt >= 0);
+
+    chan->sample->sampleRun<INTERPOLATOR>(run, data);
+
+    const int end = SPU->bufpos;
+    for (int i = 0; i < run.length; i++)
+    {
+      SPU->bufpos = start + i;
+      SPU_Mix<CHANNELS>(SPU, chan, data[i]);
+    }
+    SPU->bufpos = end;
   }
 }
 
-template<int FORMAT>
+//WORK
+  template<int FORMAT, int CHANNELS, typename INTERPOLATOR>
+FORCEINLINE static void ____SPU_ChanUpdate(SPU_struct* const SPU, channel_struct* const chan)
+{
+  if (CHANNELS != -1)
+  {
+    if (FORMAT == 3)
+      ____SPU_ChanUpdatePSG<CHANNELS>(SPU, chan);
+    else
+      ____SPU_ChanUpdateRuns<FORMAT,CHANNELS,INTERPOLATOR>(SPU, chan);
+    return;
+  }
+
+  for (; SPU->bufpos < SPU->buflength; SPU->bufpos++)
+    SPU_ChanAdvance<FORMAT>(SPU, chan);
+}
+
+template<int FORMAT, typename INTERPOLATOR>
 FORCEINLINE static void ___SPU_ChanUpdate(const bool actuallyMix, SPU_struct* const SPU, channel_struct* const chan)
 {
   if(!actuallyMix)
-    ____SPU_ChanUpdate<FORMAT,-1>(SPU,chan);
+    ____SPU_ChanUpdate<FORMAT,-1,INTERPOLATOR>(SPU,chan);
   else if (chan->pan == 0)
-    ____SPU_ChanUpdate<FORMAT,0>(SPU,chan);
+    ____SPU_ChanUpdate<FORMAT,0,INTERPOLATOR>(SPU,chan);
   else if (chan->pan == 127)
-    ____SPU_ChanUpdate<FORMAT,2>(SPU,chan);
+    ____SPU_ChanUpdate<FORMAT,2,INTERPOLATOR>(SPU,chan);
   else
-    ____SPU_ChanUpdate<FORMAT,1>(SPU,chan);
+    ____SPU_ChanUpdate<FORMAT,1,INTERPOLATOR>(SPU,chan);
+}
+
+template<int FORMAT>
+FORCEINLINE static void __SPU_ChanUpdate(const bool actuallyMix, SPU_struct* const SPU, channel_struct* const chan)
+{
+  switch(CommonSettings.spuInterpolationMode)
+  {
+    case SPUInterpolation_Linear: ___SPU_ChanUpdate<FORMAT,LinearInterpolator>(actuallyMix, SPU, chan); break;
+    case SPUInterpolation_Cosine: ___SPU_ChanUpdate<FORMAT,CosineInterpolator>(actuallyMix, SPU, chan); break;
+    case SPUInterpolation_Sharp: ___SPU_ChanUpdate<FORMAT,SharpIInterpolator>(actuallyMix, SPU, chan); break;
+    default: ___SPU_ChanUpdate<FORMAT,NoInterpolator>(actuallyMix, SPU, chan); break;
+  }
 }
 
 FORCEINLINE static void _SPU_ChanUpdate(const bool actuallyMix, SPU_struct* const SPU, channel_struct* const chan)
 {
   switch(chan->format)
   {
-    case 0: ___SPU_ChanUpdate<0>(actuallyMix, SPU, chan); break;
-    case 1: ___SPU_ChanUpdate<1>(actuallyMix, SPU, chan); break;
-    case 2: ___SPU_ChanUpdate<2>(actuallyMix, SPU, chan); break;
-    case 3: ___SPU_ChanUpdate<3>(actuallyMix, SPU, chan); break;
+    case 0: __SPU_ChanUpdate<0>(actuallyMix, SPU, chan); break;
+    case 1: __SPU_ChanUpdate<1>(actuallyMix, SPU, chan); break;
+    case 2: __SPU_ChanUpdate<2>(actuallyMix, SPU, chan); break;
+    // PSG and noise aren't read from memory, so there is nothing to interpolate
+    case 3: ___SPU_ChanUpdate<3,NoInterpolator>(actuallyMix, SPU, chan); break;
     default: assert(false);
   }
 }
 
+//when nothing is being captured and both outputs come straight from the mixer,
+//the per-sample bookkeeping below has nothing to do, so each channel can be
+//rendered across the whole block directly into sndbuf instead.
+//the sums are the same, so this gives bit-identical output.
+static void SPU_MixAudio_Block(SPU_struct *SPU, int length)
+{
+  memset(SPU->sndbuf, 0, length*4*2);
+  SPU->buflength = length;
+
+  for (int i = 0; i < 16; i++)
+  {
+    channel_struct *chan = &SPU->channels[i];
+
+    if (chan->status == CHANSTAT_PLAY)
+    {
+      SPU->bufpos = 0;
+
+      //muted channels still have to advance
+      _SPU_ChanUpdate(!CommonSettings.spu_muteChannels[i], SPU, chan);
+    }
+  }
+}
+
 //ENTERNEW
 static void SPU_MixAudio_Advanced(bool actuallyMix, SPU_struct *SPU, int length)
 {
@@ -1120,6 +1298,14 @@ static void SPU_MixAudio_Advanced(bool actuallyMix, SPU_struct *SPU, int length)
   //BIAS gets ignored since our spu is still not bit perfect,
   //and it doesnt matter for purposes of capture
 
+  if (!SPU->regs.cap[0].runtime.running && !SPU->regs.cap[1].runtime.running
+    && SPU->regs.ctl_left == SPU_struct::REGS::LOM_LEFT_MIXER && SPU->regs.ctl_right == SPU_struct::REGS::ROM_RIGHT_MIXER
+    && !SPU->regs.ctl_ch1bypass && !SPU->regs.ctl_ch3bypass)
+  {
+    SPU_MixAudio_Block(SPU, length);
+    return;
+  }
+
   //-----------DEBUG CODE
   bool skipcap = false;
   //-----------------
@@ -1317,12 +1503,21 @@ static void SPU_MixAudio_Advanced(bool actuallyMix, SPU_struct *SPU, int length)
 }
 
 //ENTER
-static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
+static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length, s16 *outbuf)
 {
+  // Samples whose memory was written to are dropped here, and the channels
+  // look them up again (decoding them anew if needed) on their next fetch
+  if (sampleCache.needsMaintenance())
+  {
+    for (int i = 0; i < 16; i++)
+      SPU->channels[i].sample = NULL;
+    sampleCache.maintain();
+  }
+
   if (actuallyMix)
   {
     memset(SPU->sndbuf, 0, length*4*2);
-    memset(SPU->outbuf, 0, length*2*2);
+    memset(outbuf, 0, length*2*2);
   }
 
   SPU_MixAudio_Advanced(actuallyMix, SPU, length);
@@ -1343,7 +1538,7 @@ static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
       // Apply Master Volume
       SPU->sndbuf[i] = spumuldiv7(SPU->sndbuf[i], vol);
       s16 outsample = MinMax(SPU->sndbuf[i],-0x8000,0x7FFF);
-      SPU->outbuf[i] = outsample;
+      outbuf[i] = outsample;
     }
   }
 }
@@ -1364,7 +1559,28 @@ void SPU_Emulate_core()
   spu_core_samples = (int)(samples);
   samples -= spu_core_samples;
 
-  SPU_MixAudio(needToMix, SPU_core, spu_core_samples);
+  if (sinkEnabled)
+  {
+    u32 count = spu_core_samples;
+    if (count <= sinkSpace)
+    {
+      SPU_MixAudio(needToMix, SPU_core, count, sinkBuffer);
+      sinkBuffer += count * 2;
+      sinkSpace -= count;
+    }
+    else
+    {
+      // mix the hline as usual and split it between the sink and the carry-over
+      SPU_MixAudio(needToMix, SPU_core, count, SPU_core->outbuf);
+      std::copy_n(SPU_core->outbuf, sinkSpace * 2, sinkBuffer);
+      sinkCarry.insert(sinkCarry.end(), SPU_core->outbuf + sinkSpace * 2, SPU_core->outbuf + count * 2);
+      sinkBuffer += sinkSpace * 2;
+      sinkSpace = 0;
+    }
+    return;
+  }
+
+  SPU_MixAudio(needToMix, SPU_core, spu_core_samples, SPU_core->outbuf);
 
   if (soundProcessor == NULL)
   {
@@ -1427,6 +1643,26 @@ void SPU_Emulate_user(bool mix)
   soundProcessor->UpdateAudio(postProcessBuffer, processedSampleCount);
 }
 
+void SPU_SetSink(s16 *buffer, u32 sampleCount)
+{
+  sinkEnabled = true;
+
+  u32 carried = std::min<u32>(sinkCarry.size() / 2, sampleCount);
+  if (carried)
+  {
+    std::copy_n(sinkCarry.begin(), carried * 2, buffer);
+    sinkCarry.erase(sinkCarry.begin(), sinkCarry.begin() + carried * 2);
+  }
+
+  sinkBuffer = buffer ? buffer + carried * 2 : NULL;
+  sinkSpace = sampleCount - carried;
+}
+
+u32 SPU_SinkSpace()
+{
+  return sinkSpace;
+}
+
 void SPU_DefaultFetchSamples(s16 *sampleBuffer, size_t sampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer)
 {
   theSynchronizer->enqueue_samples(sampleBuffer, sampleCount);
@@ -30,6 +30,7 @@
 #include "metaspu/metaspu.h"
 
 class EMUFILE;
+class SampleData;
 
 #define SNDCORE_DEFAULT         -1
 #define SNDCORE_DUMMY           0
@@ -101,7 +102,8 @@ struct channel_struct
 						index(0),
 						loop_index(0),
 						x(0),
-						psgnoise_last(0)
+						psgnoise_last(0),
+						sample(NULL)
 	{}
 	u32 num;
    u8 vol;
@@ -129,6 +131,11 @@ struct channel_struct
    int loop_index;
    u16 x;
    s16 psgnoise_last;
+   // Decoded sample for the current addr/loopstart/length, resolved from the
+   // sample cache on the first fetch after KeyOn, a change to any of those
+   // registers or the cache dropping samples, so the mixer doesn't have to
+   // look it up for every sample
+   const SampleData *sample;
 };
 
 class SPUFifo
@@ -258,6 +265,12 @@ static FORCEINLINE u16 SPU_ReadWord(u32 addr) { return SPU_core->ReadWord(addr &
 static FORCEINLINE u32 SPU_ReadLong(u32 addr) { return SPU_core->ReadLong(addr & 0x0FFF); }
 void SPU_Emulate_core(void);
 void SPU_Emulate_user(bool mix = true);
+// Direct output for players that pull audio themselves: once a sink is set, SPU_Emulate_core mixes
+// straight into the given buffer (sampleCount stereo samples) instead of passing through the sound
+// core and the synchronizer. Samples that don't fit, or that get mixed while the buffer is NULL, are
+// carried over to the start of the next buffer. SPU_DeInit goes back to the sound core.
+void SPU_SetSink(s16 *buffer, u32 sampleCount);
+u32 SPU_SinkSpace();
 void SPU_DefaultFetchSamples(s16 *sampleBuffer, size_t sampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer);
 size_t SPU_DefaultPostProcessSamples(s16 *postProcessBuffer, size_t requestedSampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer);
 
@@ -30,20 +30,28 @@
 # include <stddef.h>
 # define HAVE_STATIC_CODE_BUFFER
 #endif
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <vector>
 #include "instructions.h"
 #include "instruction_attributes.h"
 #include "MMU.h"
 #include "MMU_timing.h"
 #include "utils/AsmJit/AsmJit.h"
 #include "arm_jit.h"
+
+// the 64-bit paths below were written against the old ASMJIT_X64 define
+#if defined(ASMJIT_HOST_X64) && !defined(ASMJIT_X64)
+# define ASMJIT_X64
+#endif
 #include "bios.h"
 
 #define LOG_JIT_LEVEL 0
-#define PROFILER_JIT_LEVEL 0
-
-#if PROFILER_JIT_LEVEL > 0
-# include <algorithm>
-#endif
 
 using namespace asmjit;
 
@@ -72,12 +80,10 @@ using namespace asmjit;
 #define printJIT(buf, val)
 #endif
 
-#ifdef MAPPED_JIT_FUNCS
 CACHE_ALIGN JIT_struct JIT;
+JIT_loop_struct JIT_loop;
 
-uintptr_t *JIT_struct::JIT_MEM[2][0x4000] = { { 0 }, { 0 } };
-
-static uintptr_t *JIT_MEM[][32] =
+static uintptr_t **JIT_BANK[][32] =
 {
 	//arm9
 	{
@@ -129,7 +135,7 @@ static uint32_t JIT_MASK[][32] =
 	{
 		/* 0X*/	DUP2(0x00007FFF),
 		/* 1X*/	DUP2(0x00007FFF),
-		/* 2X*/	DUP2(0x003FFFFF), // FIXME _MMU_MAIN_MEM_MASK
+		/* 2X*/	DUP2(0x003FFFFF),
 		/* 3X*/	DUP2(0x00007FFF),
 		/* 4X*/	DUP2(0x00000000),
 		/* 5X*/	DUP2(0x00000000),
@@ -169,6 +175,60 @@ static uint32_t JIT_MASK[][32] =
 	}
 };
 
+// The blocks of a page that arm_jit_close kept for the next run, see arm_jit_reset, along with the
+// code of the page at the time and how each block was compiled.
+struct JIT_kept_blocks
+{
+	uintptr_t funcs[JIT_struct::PAGE_FUNCS];
+	std::bitset<JIT_struct::PAGE_FUNCS> thumb, arm7;
+	// as each CPU reads it, which only differs in the shared WRAM
+	std::vector<uint16_t> code[2];
+};
+
+// A compiled page: the function pointers JIT_MEM points at, followed by a
+// count of how many times each 16 bytes have been compiled (a nibble each),
+// and which CPU and mode each block was compiled for.
+struct JIT_page
+{
+	uintptr_t funcs[JIT_struct::PAGE_FUNCS];
+	uint8_t recompile_counts[(1 << JIT_struct::PAGE_SHIFT) / 32];
+	std::bitset<JIT_struct::PAGE_FUNCS> thumb, arm7;
+	std::unique_ptr<JIT_kept_blocks> kept;
+};
+
+struct JIT_allocated_page
+{
+	uintptr_t **bank;
+	uint32_t page;
+	JIT_page *data;
+	// where the page was first compiled from, to read its code back through the MMU
+	uint32_t adr;
+};
+
+// what unallocated pages point at, only ever written with zeros
+static uintptr_t JIT_empty_page[JIT_struct::PAGE_FUNCS];
+static std::vector<JIT_allocated_page> JIT_pages;
+// whether the blocks in JIT_pages were kept by arm_jit_close, and the jit_max_block_size they were
+// compiled with, the only setting the generated code depends on
+static bool JIT_kept;
+static int JIT_kept_block_size;
+
+// Points every mirror of the given page of a bank at funcs, for both CPUs.
+static void map_jit_page(uintptr_t **bank, uint32_t page, uintptr_t *funcs)
+{
+	bank[page] = funcs;
+	for (int proc = 0; proc < 2; ++proc)
+		for (int region = 0; region < 32; ++region)
+		{
+			if (JIT_BANK[proc][region] != bank)
+				continue;
+			uint32_t step = (JIT_MASK[proc][region] + 1) >> JIT_struct::PAGE_SHIFT;
+			uintptr_t **mem = JIT.JIT_MEM[proc] + (region << (23 - JIT_struct::PAGE_SHIFT));
+			for (uint32_t i = page; i < (1 << (23 - JIT_struct::PAGE_SHIFT)); i += step)
+				mem[i] = funcs;
+		}
+}
+
 static void init_jit_mem()
 {
 	static bool inited = false;
@@ -176,14 +236,71 @@ static void init_jit_mem()
 		return;
 	inited = true;
 	for (int proc = 0; proc < 2; ++proc)
-		for (int i = 0; i < 0x4000; ++i)
-			JIT.JIT_MEM[proc][i] = JIT_MEM[proc][i >> 9] + (((i << 14) & JIT_MASK[proc][i >> 9]) >> 1);
+		for (int i = 0; i < 0x10000; ++i)
+		{
+			uintptr_t **bank = JIT_BANK[proc][i >> (23 - JIT_struct::PAGE_SHIFT)];
+			if (bank)
+				bank[((i << JIT_struct::PAGE_SHIFT) & JIT_MASK[proc][i >> (23 - JIT_struct::PAGE_SHIFT)]) >> JIT_struct::PAGE_SHIFT] = JIT_empty_page;
+			JIT.JIT_MEM[proc][i] = bank ? JIT_empty_page : nullptr;
+		}
+}
+
+// Returns the page holding the compiled function for adr, allocating it the first time.
+static JIT_page *get_jit_page(uint32_t adr, int proc)
+{
+	adr &= 0x0FFFFFFF;
+	uintptr_t *funcs = JIT.JIT_MEM[proc][adr >> JIT_struct::PAGE_SHIFT];
+	if (funcs != JIT_empty_page)
+		return reinterpret_cast<JIT_page *>(funcs);
+
+	uintptr_t **bank = JIT_BANK[proc][adr >> 23];
+	uint32_t page = (adr & JIT_MASK[proc][adr >> 23]) >> JIT_struct::PAGE_SHIFT;
+	JIT_page *data = new JIT_page();
+	JIT_pages.push_back({ bank, page, data, adr & ~((1 << JIT_struct::PAGE_SHIFT) - 1) });
+	map_jit_page(bank, page, data->funcs);
+	return data;
+}
+
+static void release_code(uintptr_t func);
+
+static void release_funcs(uintptr_t *funcs)
+{
+	for (uint32_t i = 0; i < JIT_struct::PAGE_FUNCS; ++i)
+		if (funcs[i])
+			release_code(funcs[i]);
+}
+
+// Drops every compiled page, only touching the ones that were actually allocated.
+static void free_jit_pages()
+{
+	for (auto &allocated : JIT_pages)
+	{
+		release_funcs(allocated.data->funcs);
+		if (allocated.data->kept)
+			release_funcs(allocated.data->kept->funcs);
+		map_jit_page(allocated.bank, allocated.page, JIT_empty_page);
+		delete allocated.data;
+	}
+	JIT_pages.clear();
+	JIT_kept = false;
+}
+
+// The code the blocks of a page can have been compiled from: the page itself, and as much of the next
+// page as the longest block reaches from its end, without leaving the 8MB region the page is in.
+template<int PROCNUM> static std::vector<uint16_t> read_jit_page_code(uint32_t start)
+{
+	uint32_t end = std::min(start + (1 << JIT_struct::PAGE_SHIFT) + CommonSettings.jit_max_block_size * 4, (start | 0x7FFFFF) + 1);
+	std::vector<uint16_t> code;
+	code.reserve((end - start) >> 1);
+	for (uint32_t adr = start; adr < end; adr += 4)
+	{
+		uint32_t word = _MMU_read32<PROCNUM, MMU_AT_CODE>(adr);
+		code.push_back(word & 0xFFFF);
+		code.push_back(word >> 16);
+	}
+	return code;
 }
-#else
-DS_ALIGN(4096) uintptr_t compiled_funcs[1 << 26] = {0};
-#endif
 
-static uint8_t recompile_counts[(1 << 26) / 16];
 
 #ifdef HAVE_STATIC_CODE_BUFFER
 // On x86_64, allocate jitted code from a static buffer to ensure that it's within 2GB of .text
@@ -192,13 +309,14 @@ static uint8_t recompile_counts[(1 << 26) / 16];
 // FIXME win64 needs this too, x86_32 doesn't
 
 DS_ALIGN(4096) static uint8_t scratchpad[1 << 25];
-static uint8_t *scratchptr;
+
+// room kept free at the end of the buffer, so the block being compiled always fits
+static const size_t SCRATCHPAD_RESERVE = 1 << 20;
 
 struct StaticCodeSetup
 {
 	StaticCodeSetup()
 	{
-		scratchptr = scratchpad;
 		int align = reinterpret_cast<uintptr_t>(scratchpad) & (sysconf(_SC_PAGESIZE) - 1);
 		int err = mprotect(scratchpad - align, sizeof(scratchpad) + align, PROT_READ | PROT_WRITE | PROT_EXEC);
 		if (err)
@@ -212,11 +330,40 @@ struct StaticCodeSetup
 static StaticCodeSetup setup;
 static StaticRuntime codegen(scratchpad, sizeof(scratchpad));
 static X86Compiler c(&codegen);
+
+// the buffer is only ever freed all at once, by rewinding it
+static void release_code(uintptr_t) { }
+
+static void rewind_code()
+{
+	codegen.~StaticRuntime();
+	new(&codegen) StaticRuntime(scratchpad, sizeof(scratchpad));
+}
+
+// Compiler::reset() forgets the base address, without which the static
+// runtime refuses to relocate the code and make() silently returns nullptr
+static void begin_code() { c.setBaseAddress(codegen.getBaseAddress()); }
+
+static bool code_buffer_full()
+{
+	return scratchpad + sizeof(scratchpad) - reinterpret_cast<uint8_t *>(static_cast<uintptr_t>(codegen.getBaseAddress())) < static_cast<ptrdiff_t>(SCRATCHPAD_RESERVE);
+}
 #else
 static JitRuntime runtime;
 static X86Compiler c(&runtime);
+
+static void release_code(uintptr_t func) { runtime.getMemMgr()->release(reinterpret_cast<void *>(func)); }
+static void rewind_code() { }
+static void begin_code() { }
+static bool code_buffer_full() { return false; }
 #endif
 
+static void flush_jit()
+{
+	free_jit_pages();
+	rewind_code();
+}
+
 static void emit_branch(int cond, Label to);
 static void _armlog(uint8_t proc, uint32_t addr, uint32_t opcode);
 
@@ -261,41 +408,117 @@ static inline uint32_t _REG_NUM(uint32_t i, uint32_t n) { return (i >> n) & 0x7;
 	auto ctxCPSR = c.addCall(imm_ptr(NDS_Reschedule), ASMJIT_STDLIB_CALL_CONV, FuncBuilder0<void>()); \
 }
 
-#if PROFILER_JIT_LEVEL > 0
-struct PROFILER_COUNTER_INFO
-{
-	uint64_t count;
-	char name[64];
-};
+// Runtime profile, see arm_jit_profile. The blocks live in a deque so compiled code can keep
+// pointers to their counters, and are found again by address when their code gets recompiled.
+static std::deque<JIT_profile_block> profile_blocks;
+static std::unordered_map<uint64_t, JIT_profile_block *> profile_lookup;
+static JIT_profile profile_totals;
+static JIT_profile_block *bb_profile;
 
-struct JIT_PROFILER
+static JIT_profile_block *get_profile_block(uint32_t adr, int proc, bool thumb)
 {
-	JIT_PROFILER::JIT_PROFILER()
-	{
-		memset(&this->arm_count[0], 0, sizeof(this->arm_count));
-		memset(&this->thumb_count[0], 0, sizeof(this->thumb_count));
-	}
-
-	uint64_t arm_count[4096];
-	uint64_t thumb_count[1024];
-} profiler_counter[2];
-
-static GpVar bb_profiler;
-
-#define profiler_counter_arm(opcode) x86::qword_ptr(bb_profiler, offsetof(JIT_PROFILER, arm_count[INSTRUCTION_INDEX(opcode)]))
-#define profiler_counter_thumb(opcode) x86::qword_ptr(bb_profiler, offsetof(JIT_PROFILER, thumb_count[opcode>>6]))
+	uint64_t key = (static_cast<uint64_t>(proc) << 33) | (static_cast<uint64_t>(thumb) << 32) | adr;
+	auto found = profile_lookup.find(key);
+	if (found != profile_lookup.end())
+		return found->second;
+	profile_blocks.push_back({ adr, static_cast<uint8_t>(proc), thumb, 0, 0, 0, false, 0 });
+	return profile_lookup[key] = &profile_blocks.back();
+}
 
-#if PROFILER_JIT_LEVEL > 1
-struct PROFILER_ENTRY
+// adds value to one of bb_profile's 64-bit counters
+static void emit_profile_add(size_t offset, const Operand &value)
 {
-	uint32_t addr;
-	uint32_t cycles;
-} profiler_entry[2][1<<26];
+	GpVar p = c.newGpVar(kVarTypeIntPtr);
+	c.mov(p, reinterpret_cast<uintptr_t>(bb_profile));
+#ifdef ASMJIT_X64
+	if (value.isImm())
+		c.add(x86::qword_ptr(p, offset), static_cast<const Imm &>(value));
+	else
+		c.add(x86::qword_ptr(p, offset), static_cast<const GpVar &>(value));
+#else
+	if (value.isImm())
+		c.add(x86::dword_ptr(p, offset), static_cast<const Imm &>(value));
+	else
+		c.add(x86::dword_ptr(p, offset), static_cast<const GpVar &>(value));
+	c.adc(x86::dword_ptr(p, offset + 4), 0);
+#endif
+	c.unuse(p);
+}
 
-static GpVar bb_profiler_entry;
+// sets nds_timer to where armInnerLoop would have after the block's cycles so far, and with advance,
+// moves JIT_loop's timer_base there too, for the block it chains to
+static void emit_loop_timer(const GpVar &loop, bool advance)
+{
+	GpVar x = c.newGpVar(kVarTypeIntPtr);
+	GpVar timer = c.newGpVar(kVarTypeIntPtr);
+	c.mov(x, bb_total_cycles);
+	if (PROCNUM == ARMCPU_ARM7)
+		c.shl(x, 1);
+	c.mov(timer, reinterpret_cast<uintptr_t>(&nds_timer));
+#ifdef ASMJIT_X64
+	c.add(x, x86::qword_ptr(loop, offsetof(JIT_loop_struct, timer_base)));
+	if (advance)
+		c.mov(x86::qword_ptr(loop, offsetof(JIT_loop_struct, timer_base)), x);
+	c.mov(x86::qword_ptr(timer), x);
+#else
+	GpVar hi = c.newGpVar(kVarTypeInt32);
+	c.mov(hi, x86::dword_ptr(loop, offsetof(JIT_loop_struct, timer_base) + 4));
+	c.add(x, x86::dword_ptr(loop, offsetof(JIT_loop_struct, timer_base)));
+	c.adc(hi, 0);
+	if (advance)
+	{
+		c.mov(x86::dword_ptr(loop, offsetof(JIT_loop_struct, timer_base)), x);
+		c.mov(x86::dword_ptr(loop, offsetof(JIT_loop_struct, timer_base) + 4), hi);
+	}
+	c.mov(x86::dword_ptr(timer), x);
+	c.mov(x86::dword_ptr(timer, 4), hi);
+	c.unuse(hi);
 #endif
+	c.unuse(x);
+	c.unuse(timer);
+}
 
+// Assembles the block behind an entry point that calls it and, when it returns 0, jumps on to the
+// block it chained to. The jump can't be made from the block itself, as asmjit only emits a function's
+// epilogue along with its ret. From here, the next block finds the stack the way armcpu_exec left it,
+// so a chain of any length runs in constant stack, and returns straight to armcpu_exec at its end.
+static void *make_block(X86FuncNode *func)
+{
+	// keeps the stack aligned at the call the way the calling convention has it at ours,
+	// with room for the callee's register home area on Win64
+#if defined(_WIN64)
+	static const int frame = 40;
+#elif defined(ASMJIT_X64)
+	static const int frame = 8;
+#else
+	static const int frame = 12;
 #endif
+	// the compiler's labels are plain indices into the assembler's, and it adds more of its own while
+	// serializing, so the stub's label comes from the compiler too, and is never bound there
+	Label chain = c.newLabel();
+	X86Assembler *a = static_cast<X86Assembler *>(c.getAssembler());
+	a->_registerIndexedLabels(c._targetList.getLength());
+	a->sub(a->zsp, frame);
+	a->call(func->getEntryLabel());
+	a->add(a->zsp, frame);
+	a->test(x86::eax, x86::eax);
+	a->jz(chain);
+	a->ret();
+	a->bind(chain);
+	a->mov(a->zcx, reinterpret_cast<uintptr_t>(&JIT_loop.next));
+	a->jmp(x86::ptr(a->zcx));
+
+	Error error = c.serialize(a);
+	if (error == kErrorOk)
+	{
+		void *code = a->make();
+		error = a->getError();
+		if (error == kErrorOk)
+			return code;
+	}
+	c.setError(error);
+	return nullptr;
+}
 
 // -----------------------------------------------------------------------------
 //   Shifting macros
@@ -2172,8 +2395,8 @@ template<int PROCNUM, bool store, int dir> static uint32_t LDM_FASTCALL OP_LDM_S
 	uint32_t cycles;
 	uint8_t *ptr;
 
-	if ((adr ^ (adr + (dir > 0 ? (n - 1) * 4 : -15 * 4))) & ~0x3FFF) // a little conservative, but we don't want to run too many comparisons
-		// the memory region spans a page boundary, so we can't factor the address translation out of the loop
+	if ((adr ^ (adr + (dir > 0 ? (n - 1) * 4 : -15 * 4))) & ~0xFFF) // a little conservative, but we don't want to run too many comparisons
+		// the memory region spans a page boundary, so we can't factor the address translation (or the JIT page) out of the loop
 		return OP_LDM_STM_generic<PROCNUM, store, dir>(adr, regs, n);
 	else if (PROCNUM == ARMCPU_ARM9 && (adr & ~0x3FFF) == MMU.DTCMRegion)
 	{
@@ -2188,6 +2411,12 @@ template<int PROCNUM, bool store, int dir> static uint32_t LDM_FASTCALL OP_LDM_S
 	{
 		ptr = MMU.MAIN_MEM + (adr & _MMU_MAIN_MEM_MASK32);
 		cycles = n * (PROCNUM == ARMCPU_ARM9 ? 4 : 2);
+		if (store)
+		{
+			// at most 64 bytes, so no more than 2 sample cache pages
+			sampleCache.notifyWrite(adr);
+			sampleCache.notifyWrite(adr + (n - 1) * 4 * dir);
+		}
 	}
 	else if (PROCNUM == ARMCPU_ARM7 && !store && (adr & 0xFF800000) == 0x03800000)
 	{
@@ -3672,7 +3901,7 @@ static int OP_B_COND(uint32_t i)
 {
 	Label skip = c.newLabel();
 
-	uint32_t dst = bb_r15 + ((i & 0xFF) << 1);
+	uint32_t dst = bb_r15 + (static_cast<uint32_t>(static_cast<int8_t>(i & 0xFF)) << 1);
 
 	c.mov(cpu_ptr(instruct_adr), bb_next_instruction);
 
@@ -3990,6 +4219,253 @@ static void _armlog(uint8_t proc, uint32_t addr, uint32_t opcode)
 #endif
 }
 
+// Whether opcode, at the given address, is a plain branch back to adr (B, or Thumb B/Bcc)
+static bool instr_branches_to(uint32_t opcode, uint32_t opcode_adr, uint32_t adr)
+{
+	if (bb_thumb)
+	{
+		if ((opcode & 0xF000) == 0xD000 && ((opcode >> 8) & 0xF) < 0xE)
+			return opcode_adr + 4 + (static_cast<uint32_t>(static_cast<int8_t>(opcode & 0xFF)) << 1) == adr;
+		if ((opcode & 0xF800) == 0xE000)
+			return opcode_adr + 4 + (SIGNEXTEND_11(opcode) << 1) == adr;
+		return false;
+	}
+
+	return (opcode & 0x0F000000) == 0x0A000000 && CONDITION(opcode) != 0xF && opcode_adr + 8 + (SIGNEXTEND_24(opcode) << 2) == adr;
+}
+
+// Idle loop detection: a block that branches back to itself is an idle loop if every pass does
+// exactly what the one before did. That holds when it only loads from memory (or from I/O registers
+// that just report state) and every register or flag it reads is either left alone by the block or
+// set earlier in the same pass. Such a loop can only be ended by the other CPU or a hardware event,
+// which is what lets armInnerLoop skip ahead. The checks run while the block is compiled, before each
+// instruction is interpreted for the first time, so load addresses are taken from the live registers.
+// If on top of that it only loads from memory the other CPU can't reach, or from I/O registers that it
+// can only change through writes that reschedule, the loop is parked: armInnerLoop doesn't need to run
+// it again until the end of the work unit.
+// The addresses seen while compiling only stand for later entries if they can't come out differently,
+// so each value is traced back to the registers it was computed from at the start of the block. A
+// load through a value loaded from memory (other than a literal) rules the loop out, and before the
+// block reports itself idle it checks that the starting registers the addresses came from still hold
+// what they held when it was compiled.
+static const uint32_t IDLE_FLAGS = 1 << 16;
+// in bb_idle_deps, for values loaded from memory
+static const uint32_t IDLE_LOADED = 1 << 17;
+static bool bb_idle, bb_idle_private, bb_idle_dtcm, bb_idle_cond;
+static uint32_t bb_idle_read, bb_idle_written;
+// the starting registers and flags (and IDLE_LOADED) that each register and the flags were computed
+// from, that the current instruction reads, and that load addresses were computed from
+static uint32_t bb_idle_deps[17], bb_idle_op_deps, bb_idle_checked;
+static uint32_t bb_idle_start[16];
+
+static uint32_t idle_deps(uint32_t regs)
+{
+	uint32_t deps = 0;
+	for (int r = 0; r < 17; ++r)
+		if (regs & (1 << r))
+			deps |= bb_idle_deps[r];
+	return deps;
+}
+
+static void idle_read(uint32_t regs)
+{
+	bb_idle_read |= regs & ~bb_idle_written;
+	bb_idle_op_deps |= idle_deps(regs);
+}
+
+static void idle_write(uint32_t regs)
+{
+	bb_idle_written |= regs;
+	for (int r = 0; r < 17; ++r)
+		if (regs & (1 << r))
+			bb_idle_deps[r] = bb_idle_op_deps | (bb_idle_cond ? bb_idle_deps[r] : 0);
+}
+
+static void idle_begin(bool conditional)
+{
+	bb_idle_op_deps = 0;
+	bb_idle_cond = conditional;
+}
+
+static uint32_t idle_reg(uint32_t reg) { return reg == 15 ? bb_r15 : cpu->R[reg]; }
+
+static bool idle_private(uint32_t adr)
+{
+	if (PROCNUM == ARMCPU_ARM9)
+	{
+		if ((adr & ~0x3FFF) == MMU.DTCMRegion)
+			return bb_idle_dtcm = true;
+		return adr < 0x02000000 || adr >= 0xFFFF0000; // ITCM, BIOS
+	}
+	return adr < 0x4000 || (adr & 0xFF800000) == 0x03800000; // BIOS, WRAM
+}
+
+// A load into Rd from adr, computed from the base registers
+static bool idle_load(uint32_t adr, uint32_t base, uint32_t Rd)
+{
+	uint32_t deps = idle_deps(base);
+	idle_read(base);
+	if (deps & (IDLE_LOADED | IDLE_FLAGS))
+		return false;
+	bb_idle_checked |= deps;
+	bb_idle_op_deps = (bb_idle_cond ? bb_idle_deps[16] : 0) | (base == 1 << 15 ? 0 : IDLE_LOADED);
+	idle_write(1 << Rd);
+
+	if ((adr & 0x0F000000) != 0x04000000)
+	{
+		bb_idle_private = bb_idle_private && idle_private(adr);
+		return true;
+	}
+
+	switch (adr & 0x0FFFFFFC)
+	{
+		case 0x04000004: // DISPSTAT, VCOUNT
+		case 0x04000130: // KEYINPUT
+		case 0x04000134: // EXTKEYIN
+		case 0x04000180: // IPCSYNC
+		case 0x04000184: // IPCFIFOCNT
+		case 0x04000208: // IME
+		case 0x04000210: // IE
+		case 0x04000214: // IF
+			return true;
+	}
+	return false;
+}
+
+static bool arm_idle_op(uint32_t i)
+{
+	if (CONDITION(i) == 0xF)
+		return false;
+	idle_begin(CONDITION(i) != 0xE);
+	if (CONDITION(i) != 0xE)
+		idle_read(IDLE_FLAGS);
+
+	uint32_t Rn = REG_POS(i, 16), Rd = REG_POS(i, 12);
+	switch ((i >> 25) & 7)
+	{
+		case 0:
+			if ((i & 0x90) == 0x90)
+			{
+				// only LDRH/LDRSB/LDRSH with an immediate offset and no writeback
+				if (!(i & 0x60) || !BIT20(i) || !BIT24(i) || BIT21(i) || !BIT22(i) || Rd == 15)
+					return false;
+				uint32_t ofs = ((i >> 4) & 0xF0) | (i & 0xF);
+				return idle_load(BIT23(i) ? idle_reg(Rn) + ofs : idle_reg(Rn) - ofs, 1 << Rn, Rd);
+			}
+			if (BIT4(i))
+				idle_read(1 << REG_POS(i, 8));
+			idle_read(1 << REG_POS(i, 0));
+			if (((i >> 5) & 3) == 3 && !(i & 0xF90))
+				idle_read(IDLE_FLAGS); // RRX
+			// fall through
+		case 1:
+		{
+			uint32_t op = (i >> 21) & 0xF;
+			if (op >= 8 && op <= 11 && !BIT20(i))
+				return false; // MRS, MSR, BX and the like
+			if (op >= 5 && op <= 7)
+				idle_read(IDLE_FLAGS);
+			if (op != 13 && op != 15)
+				idle_read(1 << Rn);
+			if (op < 8 || op > 11)
+			{
+				if (Rd == 15)
+					return false;
+				idle_write(1 << Rd);
+			}
+			if (BIT20(i))
+				idle_write(IDLE_FLAGS);
+			return true;
+		}
+		case 2:
+		{
+			// only LDR/LDRB with an immediate offset and no writeback
+			if (!BIT20(i) || !BIT24(i) || BIT21(i) || Rd == 15)
+				return false;
+			uint32_t ofs = i & 0xFFF;
+			return idle_load(BIT23(i) ? idle_reg(Rn) + ofs : idle_reg(Rn) - ofs, 1 << Rn, Rd);
+		}
+	}
+	return false;
+}
+
+static bool thumb_idle_op(uint32_t i)
+{
+	uint32_t Rd = i & 7, Rs = (i >> 3) & 7;
+	idle_begin(false);
+	switch (i >> 11)
+	{
+		case 0x00: case 0x01: case 0x02: // LSL, LSR, ASR by immediate
+			idle_read(1 << Rs);
+			idle_write((1 << Rd) | IDLE_FLAGS);
+			return true;
+		case 0x03: // ADD, SUB
+			idle_read((1 << Rs) | (BIT10(i) ? 0 : 1 << ((i >> 6) & 7)));
+			idle_write((1 << Rd) | IDLE_FLAGS);
+			return true;
+		case 0x04: // MOV immediate
+			idle_write((1 << ((i >> 8) & 7)) | IDLE_FLAGS);
+			return true;
+		case 0x05: // CMP immediate
+			idle_read(1 << ((i >> 8) & 7));
+			idle_write(IDLE_FLAGS);
+			return true;
+		case 0x06: case 0x07: // ADD, SUB immediate
+			idle_read(1 << ((i >> 8) & 7));
+			idle_write((1 << ((i >> 8) & 7)) | IDLE_FLAGS);
+			return true;
+		case 0x08:
+			if (!BIT10(i))
+			{
+				uint32_t op = (i >> 6) & 0xF;
+				idle_read(1 << Rs);
+				if (op != 9 && op != 15)
+					idle_read(1 << Rd);
+				if (op >= 2 && op <= 7)
+					idle_read(IDLE_FLAGS); // carry in, or kept by a shift of 0
+				if (op != 8 && op != 10 && op != 11)
+					idle_write(1 << Rd);
+				idle_write(IDLE_FLAGS);
+				return true;
+			}
+			else
+			{
+				uint32_t Rh = Rd | ((i >> 4) & 8), Rm = (i >> 3) & 0xF;
+				switch ((i >> 8) & 3)
+				{
+					case 0: // ADD
+						if (Rh == 15)
+							return false;
+						idle_read((1 << Rh) | (1 << Rm));
+						idle_write(1 << Rh);
+						return true;
+					case 1: // CMP
+						idle_read((1 << Rh) | (1 << Rm));
+						idle_write(IDLE_FLAGS);
+						return true;
+					case 2: // MOV
+						if (Rh == 15)
+							return false;
+						idle_read(1 << Rm);
+						idle_write(1 << Rh);
+						return true;
+				}
+			}
+			return false;
+		case 0x09: // LDR PC relative
+			return idle_load((bb_r15 & ~2) + ((i & 0xFF) << 2), 1 << 15, (i >> 8) & 7);
+		case 0x0D: // LDR immediate
+			return idle_load(cpu->R[Rs] + (((i >> 6) & 0x1F) << 2), 1 << Rs, Rd);
+		case 0x0F: // LDRB immediate
+			return idle_load(cpu->R[Rs] + ((i >> 6) & 0x1F), 1 << Rs, Rd);
+		case 0x11: // LDRH immediate
+			return idle_load(cpu->R[Rs] + (((i >> 6) & 0x1F) << 1), 1 << Rs, Rd);
+		case 0x13: // LDR SP relative
+			return idle_load(cpu->R[13] + ((i & 0xFF) << 2), 1 << 13, (i >> 8) & 7);
+	}
+	return false;
+}
+
 template<int PROCNUM> static uint32_t compile_basicblock()
 {
 #if LOG_JIT
@@ -4014,7 +4490,8 @@ template<int PROCNUM> static uint32_t compile_basicblock()
 #endif
 
 	c.reset();
-	c.addFunc(ASMJIT_CALL_CONV, FuncBuilder0<int>());
+	begin_code();
+	X86FuncNode *func = c.addFunc(ASMJIT_CALL_CONV, FuncBuilder0<int>());
 	c.getFunc()->setHint(kFuncHintNaked, true);
 	c.getFunc()->setHint(kX86FuncHintPushPop, true);
 
@@ -4026,13 +4503,26 @@ template<int PROCNUM> static uint32_t compile_basicblock()
 	bb_total_cycles = c.newGpVar(kVarTypeIntPtr);
 	c.mov(bb_total_cycles, 0);
 
-#if PROFILER_JIT_LEVEL > 0
-	JIT_COMMENT("Profiler ptr");
-	bb_profiler = c.newGpVar(kVarTypeIntPtr);
-	c.mov(bb_profiler, reinterpret_cast<uintptr_t>(&profiler_counter[PROCNUM]));
-#endif
+	Label bb_loop = c.newLabel();
+	c.bind(bb_loop);
+
+	if (bb_profile)
+	{
+		JIT_COMMENT("profiler - executions");
+		emit_profile_add(offsetof(JIT_profile_block, executions), imm(1));
+	}
 
 	bb_constant_cycles = 0;
+	bb_idle = bb_idle_private = true;
+	bb_idle_dtcm = false;
+	bb_idle_read = bb_idle_written = bb_idle_checked = 0;
+	for (int r = 0; r < 15; ++r)
+	{
+		bb_idle_deps[r] = 1 << r;
+		bb_idle_start[r] = cpu->R[r];
+	}
+	bb_idle_deps[15] = 0;
+	bb_idle_deps[16] = IDLE_FLAGS;
 	for (uint32_t i = 0, bEndBlock = 0; !bEndBlock; ++i)
 	{
 		bb_adr = start_adr + (i * bb_opcodesize);
@@ -4054,6 +4544,14 @@ template<int PROCNUM> static uint32_t compile_basicblock()
 
 		bEndBlock = i >= CommonSettings.jit_max_block_size - 1 || instr_is_branch(opcode);
 
+		if (!bEndBlock)
+			bb_idle = bb_idle && (bb_thumb ? thumb_idle_op(opcode) : arm_idle_op(opcode));
+		else if (bb_thumb ? (opcode & 0xF000) == 0xD000 : CONDITION(opcode) != 0xE)
+		{
+			idle_begin(false);
+			idle_read(IDLE_FLAGS);
+		}
+
 #if LOG_JIT
 		if (instr_is_conditional(opcode) && cycles > 1 || !cycles)
 			has_variable_cycles = true;
@@ -4064,13 +4562,6 @@ template<int PROCNUM> static uint32_t compile_basicblock()
 
 		JIT_COMMENT("%s (PC:%08X)", disassemble(opcode), bb_adr);
 
-#if PROFILER_JIT_LEVEL > 0
-		JIT_COMMENT("*** profiler - counter");
-		if (bb_thumb)
-			c.add(profiler_counter_thumb(opcode), 1);
-		else
-			c.add(profiler_counter_arm(opcode), 1);
-#endif
 		if (instr_is_conditional(opcode))
 		{
 			// 25% of conditional instructions are immediately followed by
@@ -4120,14 +4611,124 @@ template<int PROCNUM> static uint32_t compile_basicblock()
 	if (bb_constant_cycles > 0)
 		c.add(bb_total_cycles, bb_constant_cycles);
 
-#if PROFILER_JIT_LEVEL > 1
-	JIT_COMMENT("*** profiler - cycles");
-	uint32_t padr = (start_adr & 0x07FFFFFE) >> 1;
-	bb_profiler_entry = c.newGpVar(kVarTypeIntPtr);
-	c.mov(bb_profiler_entry, reinterpret_cast<uintptr_t>(&profiler_entry[PROCNUM][padr]));
-	c.add(X86Mem(bb_profiler_entry, offsetof(PROFILER_ENTRY, cycles), 4), bb_total_cycles);
-	profiler_entry[PROCNUM][padr].addr = start_adr;
+	bool self_loop = instr_branches_to(opcode, bb_adr, start_adr);
+	Label ret = c.newLabel();
+	GpVar loop = c.newGpVar(kVarTypeIntPtr);
+	if (self_loop && bb_idle && !(bb_idle_read & bb_idle_written))
+	{
+		JIT_COMMENT("idle loop, let armInnerLoop skip ahead");
+		Label busy = c.newLabel();
+		self_loop = false;
+		c.cmp(cpu_ptr(instruct_adr), start_adr);
+		c.jne(busy);
+		JIT_COMMENT("only while the loads read from where they did when the block was compiled");
+		for (int r = 0; r < 15; ++r)
+			if (bb_idle_checked & (1 << r))
+			{
+				c.cmp(reg_ptr(r), static_cast<int32_t>(bb_idle_start[r]));
+				c.jne(busy);
+			}
+		JIT_COMMENT("and only to armInnerLoop itself, which can't tell a pass from the blocks chained before it");
+		c.mov(loop, reinterpret_cast<uintptr_t>(&JIT_loop));
+		c.cmp(x86::dword_ptr(loop, offsetof(JIT_loop_struct, chained)), 0);
+		c.jne(ret);
+		c.mov(x86::byte_ptr(loop, offsetof(JIT_loop_struct, idle)), 1);
+		if (bb_idle_private)
+		{
+			if (bb_idle_dtcm)
+			{
+				JIT_COMMENT("and parked only while DTCM stays where it was");
+				GpVar bb_mmu = c.newGpVar(kVarTypeIntPtr);
+				c.mov(bb_mmu, reinterpret_cast<uintptr_t>(&MMU));
+				c.cmp(mmu_ptr(DTCMRegion), static_cast<int32_t>(MMU.DTCMRegion));
+				c.unuse(bb_mmu);
+				c.jne(ret);
+			}
+			c.mov(x86::byte_ptr(loop, offsetof(JIT_loop_struct, parked)), 1);
+		}
+		c.jmp(ret);
+		c.bind(busy);
+	}
+
+	{
+		// same checks as armInnerLoop does between blocks
+		JIT_COMMENT("keep going in generated code while the budget allows");
+		GpVar x = c.newGpVar(kVarTypeIntPtr);
+		c.mov(loop, reinterpret_cast<uintptr_t>(&JIT_loop));
+		c.cmp(bb_total_cycles.r32(), x86::dword_ptr(loop, offsetof(JIT_loop_struct, budget)));
+		c.jae(ret);
+		c.cmp(x86::byte_ptr(bb_cpu, offsetof(armcpu_t, waitIRQ)), 0);
+		c.jne(ret);
+		c.mov(x, x86::ptr(loop, offsetof(JIT_loop_struct, reschedule)));
+		c.cmp(x86::byte_ptr(x), 0);
+		c.jne(ret);
+		c.mov(x, reinterpret_cast<uintptr_t>(&execute));
+		c.cmp(x86::byte_ptr(x), 0);
+		c.je(ret);
+		c.mov(x, reinterpret_cast<uintptr_t>(&nds.freezeBus));
+		c.cmp(x86::dword_ptr(x), 0);
+		c.jne(ret);
+
+		if (self_loop)
+		{
+			JIT_COMMENT("loop back to the start of the block, unless it got overwritten");
+			Label chain = c.newLabel();
+			c.cmp(cpu_ptr(instruct_adr), start_adr);
+			c.jne(chain);
+			c.mov(x, reinterpret_cast<uintptr_t>(&JIT_COMPILED_FUNC(start_adr, PROCNUM)));
+			c.cmp(x86::ptr(x, 0, sizeof(uintptr_t)), 0);
+			c.je(ret);
+			emit_loop_timer(loop, false);
+			c.jmp(bb_loop);
+			c.bind(chain);
+		}
+
+		// looked up when the block ends rather than when it gets compiled, as pages come and go,
+		// and an invalidated block's entry is zero, like one that was never compiled
+		JIT_COMMENT("chain to the block compiled for where this one ended, if any");
+		GpVar page = c.newGpVar(kVarTypeIntPtr);
+		GpVar pages = c.newGpVar(kVarTypeIntPtr);
+#ifdef ASMJIT_X64
+		const uint32_t ptr_shift = 3;
+#else
+		const uint32_t ptr_shift = 2;
 #endif
+		c.mov(x.r32(), cpu_ptr(instruct_adr));
+		c.mov(page.r32(), x.r32());
+		c.and_(page.r32(), 0x0FFFF000);
+		c.shr(page.r32(), JIT_struct::PAGE_SHIFT);
+		c.mov(pages, reinterpret_cast<uintptr_t>(&JIT.JIT_MEM[PROCNUM][0]));
+		c.mov(page, x86::ptr(pages, page, ptr_shift));
+		c.unuse(pages);
+		c.test(page, page);
+		c.jz(ret);
+		JIT_COMMENT("one entry per halfword");
+		c.and_(x.r32(), 0xFFE);
+		c.mov(x, x86::ptr(page, x, ptr_shift - 1));
+		c.unuse(page);
+		c.test(x, x);
+		c.jz(ret);
+		c.mov(x86::ptr(loop, offsetof(JIT_loop_struct, next), sizeof(uintptr_t)), x);
+		c.unuse(x);
+		c.sub(x86::dword_ptr(loop, offsetof(JIT_loop_struct, budget)), bb_total_cycles.r32());
+		c.add(x86::dword_ptr(loop, offsetof(JIT_loop_struct, chained)), bb_total_cycles.r32());
+		emit_loop_timer(loop, true);
+		c.unuse(loop);
+		if (bb_profile)
+		{
+			JIT_COMMENT("profiler - cycles");
+			emit_profile_add(offsetof(JIT_profile_block, cycles), bb_total_cycles);
+		}
+		c.xor_(bb_total_cycles, bb_total_cycles);
+		c.ret(bb_total_cycles);
+	}
+
+	c.bind(ret);
+	if (bb_profile)
+	{
+		JIT_COMMENT("profiler - cycles");
+		emit_profile_add(offsetof(JIT_profile_block, cycles), bb_total_cycles);
+	}
 
 	c.ret(bb_total_cycles);
 #if LOG_JIT
@@ -4135,11 +4736,16 @@ template<int PROCNUM> static uint32_t compile_basicblock()
 #endif
 	c.endFunc();
 
-	ArmOpCompiled f = (ArmOpCompiled)(c.make());
+	ArmOpCompiled f = (ArmOpCompiled)(make_block(func));
 	if (c.getError())
 	{
 		fprintf(stderr, "JIT error: %s\n", ErrorUtil::asString(c.getError()));
 		f = op_decode[PROCNUM][bb_thumb];
+		if (bb_profile)
+		{
+			bb_profile->interpreted = true;
+			++profile_totals.interpreted;
+		}
 	}
 #if LOG_JIT
 	uintptr_t baddr = reinterpret_cast<uintptr_t>(f);
@@ -4151,23 +4757,114 @@ template<int PROCNUM> static uint32_t compile_basicblock()
 	return interpreted_cycles;
 }
 
+// Takes back the block that the page kept from the last run for the current instruction, if it was
+// compiled for the same CPU and mode and memory still holds the code it was compiled from, and runs it
+// through the interpreter the first time, as compile_basicblock would have while compiling it, so that
+// a warm start plays exactly like a cold one. Otherwise the block gets dropped, and false returned.
+template<int PROCNUM> static bool restore_kept_block(JIT_page *page, uint32_t &interpreted_cycles)
+{
+	uint32_t start_adr = cpu->instruct_adr;
+	uint32_t index = (start_adr & 0x00000FFE) >> 1;
+	JIT_kept_blocks *kept = page->kept.get();
+	if (!kept || !kept->funcs[index])
+		return false;
+	uintptr_t f = kept->funcs[index];
+	kept->funcs[index] = 0;
+
+	bb_thumb = cpu->CPSR.bits.T;
+	bb_opcodesize = bb_thumb ? 2 : 4;
+
+	const std::vector<uint16_t> &code = kept->code[PROCNUM];
+	bool same = kept->thumb[index] == bb_thumb && kept->arm7[index] == (PROCNUM == ARMCPU_ARM7);
+	for (uint32_t i = 0, bEndBlock = 0; same && !bEndBlock; ++i)
+	{
+		uint32_t ofs = index + i * (bb_opcodesize >> 1);
+		if (ofs + (bb_opcodesize >> 1) > code.size())
+		{
+			same = false;
+			break;
+		}
+		bb_adr = start_adr + (i * bb_opcodesize);
+		uint32_t opcode = bb_thumb ? _MMU_read16<PROCNUM, MMU_AT_CODE>(bb_adr) : _MMU_read32<PROCNUM, MMU_AT_CODE>(bb_adr);
+		same = opcode == (bb_thumb ? code[ofs] : code[ofs] | (code[ofs + 1] << 16));
+		bEndBlock = i >= CommonSettings.jit_max_block_size - 1 || instr_is_branch(opcode);
+	}
+	if (!same)
+	{
+		release_code(f);
+		return false;
+	}
+
+	interpreted_cycles = 0;
+	for (uint32_t i = 0, bEndBlock = 0; !bEndBlock; ++i)
+	{
+		bb_adr = start_adr + (i * bb_opcodesize);
+		uint32_t opcode = bb_thumb ? _MMU_read16<PROCNUM, MMU_AT_CODE>(bb_adr) : _MMU_read32<PROCNUM, MMU_AT_CODE>(bb_adr);
+		bEndBlock = i >= CommonSettings.jit_max_block_size - 1 || instr_is_branch(opcode);
+		interpreted_cycles += op_decode[PROCNUM][bb_thumb]();
+	}
+
+	JIT_COMPILED_FUNC(start_adr, PROCNUM) = f;
+	return true;
+}
+
 template<int PROCNUM> uint32_t arm_jit_compile()
 {
 	*PROCNUM_ptr = PROCNUM;
 
-	// prevent endless recompilation of self-modifying code, which would be a memleak since we only free code all at once.
-	// also allows us to clear compiled_funcs[] while leaving it sparsely allocated, if the OS does memory overcommit.
+	// out of room for code, so start over rather than overrun the buffer
+	if (code_buffer_full())
+	{
+		flush_jit();
+		if (CommonSettings.jit_profile)
+			++profile_totals.flushes;
+	}
+
 	uint32_t adr = cpu->instruct_adr;
-	uint32_t mask_adr = (adr & 0x07FFFFFE) >> 4;
-	if (((recompile_counts[mask_adr >> 1] >> 4 * (mask_adr & 1)) & 0xF) > 8)
+	bb_profile = nullptr;
+	if (!JIT_MAPPED(adr & 0x0FFFFFFF, PROCNUM))
+		return compile_basicblock<PROCNUM>();
+
+	if (CommonSettings.jit_profile)
+		bb_profile = get_profile_block(adr, PROCNUM, cpu->CPSR.bits.T);
+
+	// prevent endless recompilation of self-modifying code, which would be a memleak since we only free code all at once.
+	JIT_page *page = get_jit_page(adr, PROCNUM);
+	uint32_t mask_adr = (adr & 0x00000FFE) >> 4;
+	if (((page->recompile_counts[mask_adr >> 1] >> 4 * (mask_adr & 1)) & 0xF) > 8)
 	{
 		ArmOpCompiled f = op_decode[PROCNUM][cpu->CPSR.bits.T];
 		JIT_COMPILED_FUNC(adr, PROCNUM) = reinterpret_cast<uintptr_t>(f);
+		if (bb_profile && !bb_profile->interpreted)
+		{
+			bb_profile->interpreted = true;
+			++profile_totals.interpreted;
+		}
 		return f();
 	}
-	recompile_counts[mask_adr >> 1] += 1 << 4 * (mask_adr & 1);
+	page->recompile_counts[mask_adr >> 1] += 1 << 4 * (mask_adr & 1);
+	page->thumb[(adr & 0x00000FFE) >> 1] = cpu->CPSR.bits.T;
+	page->arm7[(adr & 0x00000FFE) >> 1] = PROCNUM == ARMCPU_ARM7;
 
-	return compile_basicblock<PROCNUM>();
+	uint32_t cycles;
+	if (restore_kept_block<PROCNUM>(page, cycles))
+		return cycles;
+
+	if (!bb_profile)
+		return compile_basicblock<PROCNUM>();
+
+	// compiling also interprets the block once, which counts as one of its executions
+	auto start = std::chrono::steady_clock::now();
+	cycles = compile_basicblock<PROCNUM>();
+	uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	++bb_profile->executions;
+	bb_profile->cycles += cycles;
+	bb_profile->compile_ns += time;
+	profile_totals.compile_ns += time;
+	if (bb_profile->compiles++)
+		++profile_totals.recompiles;
+	++profile_totals.compiles;
+	return cycles;
 }
 
 template uint32_t arm_jit_compile<0>();
@@ -4180,201 +4877,86 @@ void arm_jit_reset(bool enable)
 #ifdef _WINDOWS
 	freopen("\\desmume_jit.log", "w", stderr);
 #endif
-#endif
-#ifdef HAVE_STATIC_CODE_BUFFER
-	scratchptr = scratchpad;
 #endif
 	fprintf(stderr, "CPU mode: %s\n", enable ? "JIT" : "Interpreter");
 
 	if (enable)
-	{
 		fprintf(stderr, "JIT max block size %d instruction(s)\n", CommonSettings.jit_max_block_size);
-#ifdef MAPPED_JIT_FUNCS
-		// these pointers are allocated by asmjit and need freeing
-#ifndef HAVE_STATIC_CODE_BUFFER
-		#define JITFREE(x)  for (size_t iii = 0; iii < ARRAY_SIZE((x)); ++iii) if ((x)[iii]) runtime.getMemMgr()->release(reinterpret_cast<void *>((x)[iii])); memset((x), 0, sizeof((x)));
-			JITFREE(JIT.MAIN_MEM);
-			JITFREE(JIT.SWIRAM);
-			JITFREE(JIT.ARM9_ITCM);
-			JITFREE(JIT.ARM9_LCDC);
-			JITFREE(JIT.ARM9_BIOS);
-			JITFREE(JIT.ARM7_BIOS);
-			JITFREE(JIT.ARM7_ERAM);
-			JITFREE(JIT.ARM7_WIRAM);
-			JITFREE(JIT.ARM7_WRAM);
-		#undef JITFREE
-#endif
 
-		memset(recompile_counts, 0, sizeof(recompile_counts));
-		init_jit_mem();
-#else
-		for (int i = 0; i < sizeof(recompile_counts) / 8; ++i)
-			if (reinterpret_cast<uint64_t *>(recompile_counts)[i])
-			{
-				reinterpret_cast<uint64_t *>(recompile_counts)[i] = nullptr;
-				memset(compiled_funcs + 128 * i, 0, 128 * sizeof(*compiled_funcs));
-			}
-#endif
-	}
+	// the MMU clears entries on writes to code even when the JIT is off
+	init_jit_mem();
 
+	// the blocks kept by arm_jit_close only fit if compiled the same way, and the profile
+	// needs to see every block compiled
+	if (!JIT_kept || !enable || CommonSettings.jit_profile || CommonSettings.jit_max_block_size != JIT_kept_block_size)
+		flush_jit();
+	JIT_kept = false;
 	c.reset();
 
-#if PROFILER_JIT_LEVEL > 0
-	reconstruct(&profiler_counter[0]);
-	reconstruct(&profiler_counter[1]);
-#if PROFILER_JIT_LEVEL > 1
-	for (uint8_t t = 0; t < 2; ++t)
-	{
-		for (uint32_t i = 0; i < (1 << 26); ++i)
-			memset(&profiler_entry[t][i], 0, sizeof(PROFILER_ENTRY));
-	}
-#endif
-#endif
-}
-
-#if PROFILER_JIT_LEVEL > 0
-static int pcmp(PROFILER_COUNTER_INFO *info1, PROFILER_COUNTER_INFO *info2)
-{
-	return info2->count - info1->count;
+	profile_blocks.clear();
+	profile_lookup.clear();
+	profile_totals = JIT_profile();
 }
 
-#if PROFILER_JIT_LEVEL > 1
-static int pcmp_entry(PROFILER_ENTRY *info1, PROFILER_ENTRY *info2)
-{
-	return info1->cycles - info2->cycles;
-}
-#endif
-#endif
-
 void arm_jit_close()
 {
-#if PROFILER_JIT_LEVEL > 0
-	fprintf(stderr, "Generating profile report...");
-
-	for (uint8_t proc = 0; proc < 2; ++proc)
+	// profiled blocks count into profile_blocks, which the next arm_jit_reset clears
+	if (!profile_blocks.empty())
 	{
-		extern GameInfo gameInfo;
-		uint16_t last[2] = { 0 };
-
-		auto arm_info = std::unique_ptr<PROFILER_COUNTER_INFO[]>(new PROFILER_COUNTER_INFO[4096]);
-		auto thumb_info = std::unique_ptr<PROFILER_COUNTER_INFO[]>(new PROFILER_COUNTER_INFO[1024]);
-		memset(&arm_info[0], 0, sizeof(PROFILER_COUNTER_INFO) * 4096);
-		memset(&thumb_info[0], 0, sizeof(PROFILER_COUNTER_INFO) * 1024);
-
-		// ARM
-		last[0] = 0;
-		for (uint16_t i = 0; i < 4096; ++i)
-		{
-			uint16_t t = 0;
-			if (!profiler_counter[proc].arm_count[i])
-				continue;
+		flush_jit();
+		return;
+	}
 
-			for (t = 0; t < last[0]; ++t)
-			{
-				if (!strcmp(arm_instruction_names[i], arm_info[t].name))
-				{
-					arm_info[t].count += profiler_counter[proc].arm_count[i];
-					break;
-				}
-			}
-			if (t == last[0])
-			{
-				strcpy(arm_info[last[0]++].name, arm_instruction_names[i]);
-				arm_info[t].count = profiler_counter[proc].arm_count[i];
-			}
-		}
+	// only the blocks this run executed get kept, so the ones no longer in use don't pile up across runs
+	auto kept_end = std::remove_if(JIT_pages.begin(), JIT_pages.end(), [](JIT_allocated_page &allocated)
+	{
+		JIT_page *data = allocated.data;
+		if (data->kept)
+			release_funcs(data->kept->funcs);
+		else
+			data->kept.reset(new JIT_kept_blocks());
+		JIT_kept_blocks *kept = data->kept.get();
 
-		// THUMB
-		last[1] = 0;
-		for (uint16_t i = 0; i < 1024; ++i)
+		// interpreter fallbacks are dropped and recompiles counted afresh, as in a cold start
+		bool used[2] = { false, false };
+		for (uint32_t i = 0; i < JIT_struct::PAGE_FUNCS; ++i)
 		{
-			uint16_t t = 0;
-			if (!profiler_counter[proc].thumb_count[i])
-				continue;
-
-			for (t = 0; t < last[1]; ++t)
-				if (!strcmp(thumb_instruction_names[i], thumb_info[t].name))
-				{
-					thumb_info[t].count += profiler_counter[proc].thumb_count[i];
-					break;
-				}
-			if (t == last[1])
-			{
-				strcpy(thumb_info[last[1]++].name, thumb_instruction_names[i]);
-				thumb_info[t].count = profiler_counter[proc].thumb_count[i];
-			}
+			uintptr_t f = data->funcs[i];
+			for (auto &decode : op_decode)
+				if (f == reinterpret_cast<uintptr_t>(decode[0]) || f == reinterpret_cast<uintptr_t>(decode[1]))
+					f = 0;
+			kept->funcs[i] = f;
+			data->funcs[i] = 0;
+			if (f)
+				used[data->arm7[i]] = true;
 		}
+		kept->thumb = data->thumb;
+		kept->arm7 = data->arm7;
+		std::fill(std::begin(data->recompile_counts), std::end(data->recompile_counts), 0);
 
-		std::qsort(&arm_info[0], last[0], sizeof(PROFILER_COUNTER_INFO), (int (*)(const void *, const void *))pcmp);
-		std::qsort(&thumb_info[0], last[1], sizeof(PROFILER_COUNTER_INFO), (int (*)(const void *, const void *))pcmp);
-
-		char buf[MAX_PATH] = { 0 };
-		sprintf(buf, "\\desmume_jit%c_counter.profiler", !proc ? '9' : '7');
-		FILE *fp = fopen(buf, "w");
-		if (fp)
+		if (!used[0] && !used[1])
 		{
-			if (!gameInfo.isHomebrew)
-			{
-				fprintf(fp, "Name:   %s\n", gameInfo.ROMname);
-				fprintf(fp, "Serial: %s\n", gameInfo.ROMserial);
-			}
-			else
-				fprintf(fp, "Homebrew\n");
-			fprintf(fp, "CPU: ARM%c\n\n", !proc ? '9' : '7');
-
-			if (last[0])
-			{
-				fprintf(fp, "========================================== ARM ==========================================\n");
-				for (int i = 0; i < last[0]; ++i)
-					fprintf(fp, "%30s: %20ld\n", arm_info[i].name, arm_info[i].count);
-				fprintf(fp, "\n");
-			}
-
-			if (last[1])
-			{
-				fprintf(fp, "========================================== THUMB ==========================================\n");
-				for (int i = 0; i < last[1]; ++i)
-					fprintf(fp, "%30s: %20ld\n", thumb_info[i].name, thumb_info[i].count);
-				fprintf(fp, "\n");
-			}
-
-			fclose(fp);
+			map_jit_page(allocated.bank, allocated.page, JIT_empty_page);
+			delete data;
+			return true;
 		}
+		kept->code[0] = used[0] ? read_jit_page_code<ARMCPU_ARM9>(allocated.adr) : std::vector<uint16_t>();
+		kept->code[1] = used[1] ? read_jit_page_code<ARMCPU_ARM7>(allocated.adr) : std::vector<uint16_t>();
+		return false;
+	});
+	JIT_pages.erase(kept_end, JIT_pages.end());
+	JIT_kept = true;
+	JIT_kept_block_size = CommonSettings.jit_max_block_size;
+}
 
-#if PROFILER_JIT_LEVEL > 1
-		sprintf(buf, "\\desmume_jit%c_entry.profiler", !proc ? '9' : '7');
-		fp = fopen(buf, "w");
-		if (fp)
-		{
-			uint32_t count = 0;
-
-			fprintf(fp, "Entrypoints (cycles):\n");
-			auto tmp = std::unique_ptr<PROFILER_ENTRY[]>(new PROFILER_ENTRY[1 << 26]);
-			memset(tmp, 0, sizeof(PROFILER_ENTRY) * (1 << 26));
-			for (uint32_t i = 0; i < (1 << 26); ++i)
-			{
-				if (!profiler_entry[proc][i].cycles)
-					continue;
-				memcpy(&tmp[count++], &profiler_entry[proc][i], sizeof(PROFILER_ENTRY));
-			}
-			std::qsort(tmp, count, sizeof(PROFILER_ENTRY), (int (*)(const void *, const void *))pcmp_entry);
-			if (!gameInfo.isHomebrew)
-			{
-				fprintf(fp, "Name:   %s\n", gameInfo.ROMname);
-				fprintf(fp, "Serial: %s\n", gameInfo.ROMserial);
-			}
-			else
-				fprintf(fp, "Homebrew\n");
-			fprintf(fp, "CPU: ARM%c\n\n", !proc ? '9' : '7');
-
-			while (count-- > 0)
-				fprintf(fp, "%08X: %20ld\n", tmp[count].addr, tmp[count].cycles);
-
-			fclose(fp);
-		}
-#endif
-	}
-	fprintf(stderr, " done.\n");
-#endif
+JIT_profile arm_jit_profile()
+{
+	JIT_profile profile = profile_totals;
+	profile.blocks.assign(profile_blocks.begin(), profile_blocks.end());
+	std::stable_sort(profile.blocks.begin(), profile.blocks.end(), [](const JIT_profile_block &a, const JIT_profile_block &b)
+	{
+		return a.cycles > b.cycles;
+	});
+	return profile;
 }
 #endif // HAVE_JIT
@@ -18,46 +18,99 @@
 
 #pragma once
 
+#include <vector>
 #include "types.h"
 
 typedef uint32_t (FASTCALL *ArmOpCompiled)();
 
+// While CommonSettings.jit_profile is set, every block compiled counts its executions and the cycles
+// they took, and the compiler keeps totals of its own work. arm_jit_reset starts a new profile, and
+// blocks compiled while profiling was off count nothing, so it should be set before NDS_Reset.
+struct JIT_profile_block
+{
+	uint32_t adr;
+	uint8_t proc;
+	bool thumb;
+	// each pass a looping block makes by itself counts as an execution, cycles are the CPU's own
+	uint64_t executions, cycles;
+	uint32_t compiles;
+	// gave up on compiling after too many recompiles (or a JIT error), runs through the interpreter now
+	bool interpreted;
+	// time spent in compile_basicblock, which includes interpreting the block once
+	uint64_t compile_ns;
+};
+
+struct JIT_profile
+{
+	// most cycles first
+	std::vector<JIT_profile_block> blocks;
+	uint64_t compiles, recompiles, interpreted, flushes;
+	uint64_t compile_ns;
+};
+
+// arm_jit_close keeps the blocks the run compiled, with a copy of the code they were compiled from, so
+// that a restart (the next track of a set, or a backward seek) doesn't have to compile it all again.
+// After the next arm_jit_reset, each kept block comes back the first time it gets executed if memory
+// still holds exactly the same code by then, and is dropped otherwise. Output stays the same as with
+// a cold start, since a block's first run goes through the interpreter either way.
 void arm_jit_reset(bool enable);
 void arm_jit_close();
+JIT_profile arm_jit_profile();
 void arm_jit_sync();
 template<int PROCNUM> uint32_t arm_jit_compile();
 
-#if defined(_WINDOWS) || defined(DESMUME_COCOA) || defined(HAVE_JIT)
-# define MAPPED_JIT_FUNCS
-#endif
-
-#ifdef MAPPED_JIT_FUNCS
+// Compiled blocks are found through a two-level table: JIT_MEM maps each 4KB page of guest memory
+// to an array holding one function pointer per halfword. The arrays are only allocated once code in
+// that page gets compiled; until then, every page that code can execute from points at a shared array
+// of zeros, so the invalidation in the memory write handlers never has to check for a missing array.
 struct JIT_struct
 {
-	// only include the memory types that code can execute from
-	uintptr_t MAIN_MEM[0x800000];
-	uintptr_t SWIRAM[0x4000];
-	uintptr_t ARM9_ITCM[0x4000];
-	uintptr_t ARM9_LCDC[0x52000];
-	uintptr_t ARM9_BIOS[0x4000];
-	uintptr_t ARM7_BIOS[0x2000];
-	uintptr_t ARM7_ERAM[0x8000];
-	uintptr_t ARM7_WIRAM[0x8000];
-	uintptr_t ARM7_WRAM[0x20000];
-
-	static uintptr_t *JIT_MEM[2][0x4000];
+	static const uint32_t PAGE_SHIFT = 12;
+	static const uint32_t PAGE_FUNCS = 1 << (PAGE_SHIFT - 1);
+
+	// only include the memory types that code can execute from, one entry per page
+	uintptr_t *MAIN_MEM[0x400];
+	uintptr_t *SWIRAM[0x8];
+	uintptr_t *ARM9_ITCM[0x8];
+	uintptr_t *ARM9_LCDC[0x100];
+	uintptr_t *ARM9_BIOS[0x8];
+	uintptr_t *ARM7_BIOS[0x4];
+	uintptr_t *ARM7_ERAM[0x10];
+	uintptr_t *ARM7_WIRAM[0x10];
+	uintptr_t *ARM7_WRAM[0x40];
+
+	uintptr_t *JIT_MEM[2][0x10000];
 };
 extern CACHE_ALIGN JIT_struct JIT;
-inline uintptr_t &JIT_COMPILED_FUNC(uint32_t adr, uint32_t PROCNUM) { return JIT.JIT_MEM[PROCNUM][(adr & 0x0FFFC000) >> 14][(adr & 0x00003FFE) >> 1]; }
-inline uintptr_t &JIT_COMPILED_FUNC_PREMASKED(uint32_t adr, uint32_t PROCNUM, uint32_t ofs) { return JIT.JIT_MEM[PROCNUM][adr >> 14][((adr & 0x00003FFE) >> 1) + ofs]; }
-#define JIT_COMPILED_FUNC_KNOWNBANK(adr, bank, mask, ofs) JIT.bank[(((adr) & (mask)) >> 1) + ofs]
-inline bool JIT_MAPPED(uint32_t adr, uint32_t PROCNUM) { return !!JIT.JIT_MEM[PROCNUM][adr >> 14]; }
-#else
-// actually an array of function pointers, but they fit in 32bit address space, so might as well save memory
-extern uintptr_t compiled_funcs[];
-// there isn't anything mapped between 07000000 and 0EFFFFFF, so we can mask off bit 27 and get away with a smaller array
-inline uintptr_r &JIT_COMPILED_FUNC(uint32_t adr, uint32_t PROCNUM) { compiled_funcs[(adr & 0x07FFFFFE) >> 1]; }
-inline uintptr_t &JIT_COMPILED_FUNC_PREMASKED(uint32_t adr, uint32_t PROCNUM, uint32_t ofs) { return JIT_COMPILED_FUNC(adr, PROCNUM); }
-#define JIT_COMPILED_FUNC_KNOWNBANK(adr, bank, mask, ofs) JIT_COMPILED_FUNC(adr, PROCNUM)
-inline bool JIT_MAPPED(uint32_t adr, uint32_t PROCNUM) { return true; }
-#endif
+inline uintptr_t &JIT_COMPILED_FUNC(uint32_t adr, uint32_t PROCNUM) { return JIT.JIT_MEM[PROCNUM][(adr & 0x0FFFF000) >> 12][(adr & 0x00000FFE) >> 1]; }
+inline uintptr_t &JIT_COMPILED_FUNC_PREMASKED(uint32_t adr, uint32_t PROCNUM, uint32_t ofs) { return JIT.JIT_MEM[PROCNUM][adr >> 12][((adr & 0x00000FFE) >> 1) + ofs]; }
+#define JIT_COMPILED_FUNC_KNOWNBANK(adr, bank, mask, ofs) JIT.bank[((adr) & (mask)) >> 12][((((adr) & (mask)) & 0xFFE) >> 1) + ofs]
+inline bool JIT_MAPPED(uint32_t adr, uint32_t PROCNUM) { return !!JIT.JIT_MEM[PROCNUM][adr >> 12]; }
+
+// A compiled block that branches back to its own start keeps looping in generated code while it stays
+// within budget cycles, instead of returning to armInnerLoop after every pass. armInnerLoop sets this
+// up before each call so that the loop stops exactly where it would have switched CPUs or handled an
+// event, and the block keeps nds_timer up to date the same way armInnerLoop would.
+// Under the same checks, a block that ends anywhere else chains to the block compiled for where it
+// ended, if there is one: it takes its cycles out of budget, adds them to chained, for armcpu_exec to
+// report, and leaves the next block's entry point in next.
+// Idle loops (see compile_basicblock) don't loop by themselves, they set idle and return instead,
+// and also set parked when nothing but a rescheduling write from the other CPU can end them.
+struct JIT_loop_struct
+{
+	uint32_t budget, chained;
+	uint64_t timer_base;
+	uintptr_t next;
+	const bool *reschedule;
+	bool idle, parked;
+};
+extern JIT_loop_struct JIT_loop;
+
+// time and limit are in ARM9 cycles, as in armInnerLoop, while the budget is in the CPU's own cycles
+template<int PROCNUM> inline void arm_jit_set_budget(uint64_t nds_timer_base, int32_t time, int32_t limit)
+{
+	JIT_loop.idle = JIT_loop.parked = false;
+	JIT_loop.chained = 0;
+	JIT_loop.timer_base = nds_timer_base + time;
+	JIT_loop.budget = limit > time ? (limit - time + PROCNUM) >> PROCNUM : 0;
+}
@@ -376,7 +376,11 @@ template<int PROCNUM, bool jit> uint32_t armcpu_exec()
 	if (jit)
 	{
 		ArmOpCompiled f = reinterpret_cast<ArmOpCompiled>(JIT_COMPILED_FUNC(ARMPROC.instruct_adr, PROCNUM));
-		return f ? f() : arm_jit_compile<PROCNUM>();
+		if (!f)
+			return arm_jit_compile<PROCNUM>();
+		// plus the cycles of the blocks that chained to the one that returned
+		uint32_t cycles = f();
+		return cycles + JIT_loop.chained;
 	}
 
 	return armcpu_exec<PROCNUM>();
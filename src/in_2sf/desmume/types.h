@@ -43,6 +43,15 @@ using s8 = int8_t;
 #ifndef FORCEINLINE
 #define FORCEINLINE inline
 #endif
+#ifndef NOINLINE
+# ifdef _MSC_VER
+#  define NOINLINE __declspec(noinline)
+# elif defined(__GNUC__)
+#  define NOINLINE __attribute__((noinline))
+# else
+#  define NOINLINE
+# endif
+#endif
 
 #ifdef _WINDOWS
 # define HAVE_LIBAGG
@@ -1,54 +1,122 @@
 #include "interpolator.h"
+#include "../desmume/types.h"
 #include <cmath>
+#include <cstddef>
+#ifdef ENABLE_SSE2
+#include <emmintrin.h>
+#endif
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-static LinearInterpolator* iLin = new LinearInterpolator;
+static const int16_t* buildCosineLut()
+{
+  static int16_t lut[1 << CosineInterpolator::lutBits];
+  for(int i = 0; i < (1 << CosineInterpolator::lutBits); i++) {
+    double weight = (1.0 - std::cos(M_PI * i / 8192.0) * M_PI) * 0.5;
+    lut[i] = int16_t(std::lround(weight * (1 << CosineInterpolator::lutBits)));
+  }
+  return lut;
+}
 
-// Keep in the same order as SPUInterpolationMode
-IInterpolator* IInterpolator::allInterpolators[4] = {
-  nullptr,
-  iLin,
-  new CosineInterpolator,
-  new SharpIInterpolator
-};
+const int16_t* const CosineInterpolator::lut = buildCosineLut();
 
-static inline int32_t lerp(int32_t left, int32_t right, double weight)
+// Divides by 2^BITS, rounding toward zero like the conversion from double used to
+template<int BITS>
+static inline int32_t truncShift(int32_t sum)
 {
-  return (left * (1 - weight)) + (right * weight);
+  return (sum + ((sum >> 31) & ((1 << BITS) - 1))) >> BITS;
 }
 
-int32_t LinearInterpolator::interpolate(const std::vector<int32_t>& data, double time) const
+#ifdef ENABLE_SSE2
+// SSE2 has no 32-bit low multiply, so the even and odd lanes are multiplied separately
+static inline __m128i mullo32(__m128i a, __m128i b)
 {
-  if (time < 0) {
-    return 0;
-  }
-  return lerp(data[time], data[time + 1], time - std::floor(time));
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+template<int BITS>
+static inline __m128i truncShift(__m128i sum)
+{
+  __m128i bias = _mm_srli_epi32(_mm_srai_epi32(sum, 31), 32 - BITS);
+  return _mm_srai_epi32(_mm_add_epi32(sum, bias), BITS);
+}
+
+static inline __m128i gather(const int32_t* data, const uint32_t* index)
+{
+  return _mm_setr_epi32(data[index[0]], data[index[1]], data[index[2]], data[index[3]]);
+}
+#endif
+
+// Samples are at most 16 bits, so left * (65536 - weight) + right * weight
+// always fits in 32 bits even though the partial products may wrap.
+static inline int32_t linearSample(const int32_t* data, uint32_t index, uint32_t frac)
+{
+  int32_t left = data[index];
+  int32_t right = data[index + 1];
+  uint32_t sum = (uint32_t(left) << 16) + uint32_t(right - left) * (frac >> 16);
+  return truncShift<16>(int32_t(sum));
 }
 
-CosineInterpolator::CosineInterpolator()
+void LinearInterpolator::interpolate(const int32_t* data, const InterpolatorRun& run, int32_t* out)
 {
-  for(int i = 0; i < 8192; i++) {
-    lut[i] = (1.0 - std::cos(M_PI * i / 8192.0) * M_PI) * 0.5;
+  int i = 0;
+#ifdef ENABLE_SSE2
+  for (; i + 4 <= run.length; i += 4) {
+    __m128i left = gather(data, &run.index[i]);
+    __m128i right = _mm_setr_epi32(data[run.index[i] + 1], data[run.index[i + 1] + 1], data[run.index[i + 2] + 1], data[run.index[i + 3] + 1]);
+    __m128i weight = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&run.frac[i])), 16);
+    __m128i sum = _mm_add_epi32(_mm_slli_epi32(left, 16), mullo32(_mm_sub_epi32(right, left), weight));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]), truncShift<16>(sum));
   }
+#endif
+  for (; i < run.length; i++) {
+    out[i] = linearSample(data, run.index[i], run.frac[i]);
+  }
+}
+
+// The curve overshoots by up to about 2x the step between samples, which still
+// fits in 32 bits at 13 fractional bits.
+static inline int32_t cosineSample(const int16_t* lut, const int32_t* data, uint32_t index, uint32_t frac)
+{
+  int32_t left = data[index];
+  int32_t right = data[index + 1];
+  int32_t weight = lut[frac >> (32 - CosineInterpolator::lutBits)];
+  return truncShift<CosineInterpolator::lutBits>(right * (1 << CosineInterpolator::lutBits) + weight * (right - left));
 }
 
-int32_t CosineInterpolator::interpolate(const std::vector<int32_t>& data, double time) const
+void CosineInterpolator::interpolate(const int32_t* data, const InterpolatorRun& run, int32_t* out)
 {
-  if (time < 0) {
-    return 0;
+  int i = 0;
+#ifdef ENABLE_SSE2
+  const int shift = 32 - lutBits;
+  for (; i + 4 <= run.length; i += 4) {
+    __m128i left = gather(data, &run.index[i]);
+    __m128i right = _mm_setr_epi32(data[run.index[i] + 1], data[run.index[i + 1] + 1], data[run.index[i + 2] + 1], data[run.index[i + 3] + 1]);
+    __m128i weight = _mm_setr_epi32(lut[run.frac[i] >> shift], lut[run.frac[i + 1] >> shift], lut[run.frac[i + 2] >> shift], lut[run.frac[i + 3] >> shift]);
+    __m128i sum = _mm_add_epi32(_mm_slli_epi32(right, lutBits), mullo32(_mm_sub_epi32(right, left), weight));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]), truncShift<lutBits>(sum));
+  }
+#endif
+  for (; i < run.length; i++) {
+    out[i] = cosineSample(lut, data, run.index[i], run.frac[i]);
   }
-  int32_t left = data[time];
-  int32_t right = data[time + 1];
-  double weight = time - std::floor(time);
-  return lut[size_t(weight * 8192)] * (right - left) + right;
 }
 
-int32_t SharpIInterpolator::interpolate(const std::vector<int32_t>& data, double time) const
+// Sharp works on the read position in double precision, exactly as the per-sample
+// code did: its result is truncated at several points, so fixed point moves it by
+// an LSB here and there.
+static inline int32_t sharpLerp(int32_t left, int32_t right, double weight)
+{
+  return (left * (1 - weight)) + (right * weight);
+}
+
+static inline int32_t sharpSample(const int32_t* data, double time)
 {
   if (time <= 2) {
-    return iLin->interpolate(data, time);
+    return sharpLerp(data[size_t(time)], data[size_t(time + 1)], time - std::floor(time));
   }
 
   size_t index = size_t(time);
@@ -64,11 +132,11 @@ int32_t SharpIInterpolator::interpolate(const std::vector<int32_t>& data, double
   double subsample = time - std::floor(time);
   if ((right > right2) == (right > sample) || (left > left2) == (left > sample)) {
     // Wider history window is non-monotonic
-    return lerp(sample, right, subsample);
+    return sharpLerp(sample, right, subsample);
   }
 
   // Include a linear interpolation of the surrounding samples to try to smooth out single-sample errors
-  double linear = lerp(left, right, 1.0 + subsample);
+  double linear = sharpLerp(left, right, 1.0 + subsample);
   // Projection approaching from the left
   double mLeft = sample - left;
   // Projection approaching from the right
@@ -77,7 +145,22 @@ int32_t SharpIInterpolator::interpolate(const std::vector<int32_t>& data, double
   int32_t result = (mLeft * negSubsample + mRight * subsample + linear) / 3;
   if ((left <= result) != (result <= right)) {
     // If the result isn't monotonic, fall back to linear
-    return lerp(sample, right, subsample);
+    return sharpLerp(sample, right, subsample);
   }
   return result;
 }
+
+void SharpIInterpolator::interpolate(const int32_t* data, const InterpolatorRun& run, int32_t* out)
+{
+  // The monotonic checks branch per sample, so this stays scalar
+  int i = 0;
+  for (; i + 4 <= run.length; i += 4) {
+    out[i] = sharpSample(data, run.time[i]);
+    out[i + 1] = sharpSample(data, run.time[i + 1]);
+    out[i + 2] = sharpSample(data, run.time[i + 2]);
+    out[i + 3] = sharpSample(data, run.time[i + 3]);
+  }
+  for (; i < run.length; i++) {
+    out[i] = sharpSample(data, run.time[i]);
+  }
+}
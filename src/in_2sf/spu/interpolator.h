@@ -1,41 +1,67 @@
 #ifndef TWOSF2WAV_INTERPOLATOR_H
 #define TWOSF2WAV_INTERPOLATOR_H
 
-#include <vector>
 #include <cstdint>
 
-class IInterpolator
+// The interpolators are used as template parameters of the SPU channel update,
+// so the interpolation mode is picked once per channel update instead of
+// through a virtual call for every sample.
+//
+// Each call fills a whole run of output samples. Read positions are 32.32 fixed
+// point, split into the sample index and the fraction so the interpolators can
+// load them straight into vector registers. Sharp reads the positions as they
+// were in double precision instead.
+
+struct InterpolatorRun
 {
-public:
-  virtual ~IInterpolator() {}
+  static const int maxLength = 32;
 
-  virtual int32_t interpolate(const std::vector<int32_t>& data, double time) const = 0;
+  uint32_t index[maxLength];
+  uint32_t frac[maxLength];
+  double time[maxLength];
+  int length;
+};
 
-  static IInterpolator* allInterpolators[4];
+class NoInterpolator
+{
+public:
+  static void interpolate(const int32_t* data, const InterpolatorRun& run, int32_t* out)
+  {
+    for (int i = 0; i < run.length; i++) {
+      out[i] = data[run.index[i]];
+    }
+  }
 };
 
-class LinearInterpolator : public IInterpolator
+class LinearInterpolator
 {
 public:
-  virtual int32_t interpolate(const std::vector<int32_t>& data, double time) const;
+  static void interpolate(const int32_t* data, const InterpolatorRun& run, int32_t* out);
+
+  static int32_t lerp(int32_t left, int32_t right, uint32_t frac)
+  {
+    // Truncates toward zero like the conversion from double used to
+    int64_t sum = int64_t(left) * ((int64_t(1) << 32) - frac) + int64_t(right) * frac;
+    return int32_t(sum / (int64_t(1) << 32));
+  }
 };
 
-class CosineInterpolator : public IInterpolator
+class CosineInterpolator
 {
 public:
-  CosineInterpolator();
+  static void interpolate(const int32_t* data, const InterpolatorRun& run, int32_t* out);
 
-  virtual int32_t interpolate(const std::vector<int32_t>& data, double time) const;
+  // The curve is stored in 3.13 fixed point, indexed by the top 13 bits of the fraction
+  static const int lutBits = 13;
 
 private:
-  double lut[8192];
+  static const int16_t* const lut;
 };
 
-class SharpIInterpolator : public IInterpolator
+class SharpIInterpolator
 {
 public:
-  virtual int32_t interpolate(const std::vector<int32_t>& data, double time) const;
+  static void interpolate(const int32_t* data, const InterpolatorRun& run, int32_t* out);
 };
 
-
 #endif
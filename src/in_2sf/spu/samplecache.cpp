@@ -1,4 +1,8 @@
 #include "samplecache.h"
+#include <algorithm>
+#include <iterator>
+
+SampleCache sampleCache;
 
 static inline constexpr uint64_t makeKey(uint32_t base, uint16_t loop, uint32_t length)
 {
@@ -12,6 +16,12 @@ static inline constexpr uint64_t makeKey(uint32_t base, uint16_t loop, uint32_t
     (uint64_t(length & 0x1FFFFF) << 39);
 }
 
+SampleCache::SampleCache()
+: bytes(0), watchedPages(UNTRACKED_PAGE + 1, 0), dirtyPages(UNTRACKED_PAGE + 1, false)
+{
+  // initializers only
+}
+
 const SampleData& SampleCache::getSample(uint32_t baseAddr, uint16_t loopStartWords, uint32_t loopLengthWords, SampleData::Format format)
 {
   uint64_t key = makeKey(baseAddr, loopStartWords, loopLengthWords);
@@ -20,13 +30,73 @@ const SampleData& SampleCache::getSample(uint32_t baseAddr, uint16_t loopStartWo
     iter = samples.emplace(
       std::piecewise_construct,
       std::forward_as_tuple(key),
-      std::forward_as_tuple(baseAddr, loopStartWords << 2, (loopStartWords + loopLengthWords) << 2, format)
+      std::forward_as_tuple()
     ).first;
+    Entry& entry = iter->second;
+    entry.sample = SampleData(baseAddr, loopStartWords << 2, (loopStartWords + loopLengthWords) << 2, format);
+    bytes += entry.sample.size() * sizeof(int32_t);
+
+    // Watch every page the sample was read from, including the ADPCM header
+    uint32_t end = baseAddr + ((uint32_t(loopStartWords) + loopLengthWords) << 2);
+    for (uint32_t addr = baseAddr; addr < end; addr = (addr | ((1 << PAGE_SHIFT) - 1)) + 1) {
+      uint32_t page = pageOf(addr);
+      if (std::find(entry.pages.begin(), entry.pages.end(), page) == entry.pages.end()) {
+        entry.pages.push_back(page);
+        ++watchedPages[page];
+      }
+    }
+
+    lru.push_front(key);
+    entry.lruPos = lru.begin();
+  } else if (iter->second.lruPos != lru.begin()) {
+    lru.splice(lru.begin(), lru, iter->second.lruPos);
+  }
+  return iter->second.sample;
+}
+
+void SampleCache::erase(std::unordered_map<uint64_t, Entry>::iterator iter)
+{
+  Entry& entry = iter->second;
+  for (uint32_t page : entry.pages) {
+    --watchedPages[page];
+  }
+  bytes -= entry.sample.size() * sizeof(int32_t);
+  lru.erase(entry.lruPos);
+  samples.erase(iter);
+}
+
+void SampleCache::maintain()
+{
+  if (!dirtyList.empty()) {
+    for (auto iter = samples.begin(); iter != samples.end();) {
+      auto next = std::next(iter);
+      for (uint32_t page : iter->second.pages) {
+        if (dirtyPages[page]) {
+          erase(iter);
+          break;
+        }
+      }
+      iter = next;
+    }
+    for (uint32_t page : dirtyList) {
+      dirtyPages[page] = false;
+    }
+    dirtyList.clear();
+  }
+
+  while (bytes > MAX_BYTES && !lru.empty()) {
+    erase(samples.find(lru.back()));
   }
-  return iter->second;
 }
 
 void SampleCache::clear()
 {
   samples.clear();
+  lru.clear();
+  bytes = 0;
+  std::fill(watchedPages.begin(), watchedPages.end(), 0);
+  for (uint32_t page : dirtyList) {
+    dirtyPages[page] = false;
+  }
+  dirtyList.clear();
 }
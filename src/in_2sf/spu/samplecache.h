@@ -1,16 +1,88 @@
 #ifndef TWOSF2WAV_SAMPLECACHE_H
 #define TWOSF2WAV_SAMPLECACHE_H
 
+#include <list>
 #include <unordered_map>
+#include <vector>
 #include "sampledata.h"
 
+// Decoded samples are kept until the memory they were read from is written to
+// or until the cache grows past MAX_BYTES, at which point the least recently
+// used samples are dropped. Writes are tracked per page: the MMU reports every
+// write through notifyWrite, which only has to look at a counter when the page
+// doesn't back a cached sample.
+//
+// A reference returned by getSample stays valid until the next call to
+// maintain or clear, so holders have to let go of it whenever
+// needsMaintenance returns true.
 class SampleCache {
 public:
+  static const uint32_t PAGE_SHIFT = 8;
+  static const size_t MAX_BYTES = 64 << 20;
+
+  SampleCache();
+
   const SampleData& getSample(uint32_t baseAddr, uint16_t loopStartWords, uint32_t loopLengthWords, SampleData::Format format);
   void clear();
 
+  void notifyWrite(uint32_t addr)
+  {
+    uint32_t page = pageOf(addr);
+    if (watchedPages[page] && !dirtyPages[page] && page != UNTRACKED_PAGE) {
+      dirtyPages[page] = true;
+      dirtyList.push_back(page);
+    }
+  }
+
+  bool needsMaintenance() const
+  {
+    return !dirtyList.empty() || bytes > MAX_BYTES;
+  }
+
+  // Drops the samples read from pages written to since the last call, then
+  // the least recently used samples until the cache fits in MAX_BYTES
+  void maintain();
+
 private:
-  std::unordered_map<uint64_t, SampleData> samples;
+  struct Entry {
+    SampleData sample;
+    std::vector<uint32_t> pages;
+    std::list<uint64_t>::iterator lruPos;
+  };
+
+  // Only memory the ARM7 can both read samples from and write to is tracked:
+  // main memory, WRAM and VRAM. Mirrors of the same memory have to share
+  // pages, otherwise a write through one mirror would be missed for a sample
+  // read through another. The masks err on the side of aliasing more than the
+  // hardware does (main memory is assumed to be 4 MB, and the shared and ARM7
+  // WRAM share a window), which can only cause extra invalidations.
+  static const uint32_t MAIN_PAGES = 0x400000 >> PAGE_SHIFT;
+  static const uint32_t WRAM_PAGES = 0x10000 >> PAGE_SHIFT;
+  static const uint32_t VRAM_PAGES = 0x40000 >> PAGE_SHIFT;
+  static const uint32_t UNTRACKED_PAGE = MAIN_PAGES + WRAM_PAGES + VRAM_PAGES;
+
+  static uint32_t pageOf(uint32_t addr)
+  {
+    switch ((addr >> 24) & 0xF) {
+      case 0x2: return (addr & 0x3FFFFF) >> PAGE_SHIFT;
+      case 0x3: return MAIN_PAGES + ((addr & 0xFFFF) >> PAGE_SHIFT);
+      case 0x6: return MAIN_PAGES + WRAM_PAGES + ((addr & 0x3FFFF) >> PAGE_SHIFT);
+      default: return UNTRACKED_PAGE;
+    }
+  }
+
+  void erase(std::unordered_map<uint64_t, Entry>::iterator iter);
+
+  std::unordered_map<uint64_t, Entry> samples;
+  // Most recently used first
+  std::list<uint64_t> lru;
+  size_t bytes;
+
+  std::vector<uint32_t> watchedPages;
+  std::vector<bool> dirtyPages;
+  std::vector<uint32_t> dirtyList;
 };
 
+extern SampleCache sampleCache;
+
 #endif
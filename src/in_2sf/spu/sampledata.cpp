@@ -1,6 +1,5 @@
 #include "sampledata.h"
 #include "adpcmdecoder.h"
-#include "interpolator.h"
 #include "../desmume/MMU.h"
 
 SampleData::SampleData()
@@ -73,14 +72,3 @@ void SampleData::loadAdpcm()
     (*this)[j + loopLength] = (*this)[j];
   }
 }
-
-int32_t SampleData::sampleAt(double time, IInterpolator* interp) const
-{
-  if (!baseAddr) {
-    return 0;
-  }
-  if (!interp) {
-    return (*this)[uint32_t(time)];
-  }
-  return interp->interpolate(*this, time);
-}
@@ -1,9 +1,10 @@
 #ifndef TWOSF2WAV_SAMPLEDATA_H
 #define TWOSF2WAV_SAMPLEDATA_H
 
+#include <algorithm>
 #include <vector>
 #include <cstdint>
-class IInterpolator;
+#include "interpolator.h"
 
 class SampleData : public std::vector<int32_t>
 {
@@ -23,7 +24,15 @@ public:
   SampleData& operator=(const SampleData&) = default;
   SampleData& operator=(SampleData&&) = default;
 
-  int32_t sampleAt(double time, IInterpolator* interp = nullptr) const;
+  template<typename Interpolator>
+  void sampleRun(const InterpolatorRun& run, int32_t* out) const
+  {
+    if (!baseAddr) {
+      std::fill_n(out, run.length, 0);
+      return;
+    }
+    Interpolator::interpolate(data(), run, out);
+  }
 
   uint32_t baseAddr;
   uint16_t loopStart;
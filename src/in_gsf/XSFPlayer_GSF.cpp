@@ -48,14 +48,11 @@ static struct
 	unsigned entry;
 } loaderwork = { std::vector<std::uint8_t>(), 0 };
 
-int mapgsf(std::uint8_t *d, int l, int &s)
+// The GBA core reads the ROM from this buffer in place, see CPULoadRom
+std::uint8_t *mapgsf(int &s)
 {
-	if (static_cast<std::size_t>(l) > loaderwork.rom.size())
-		l = loaderwork.rom.size();
-	if (l)
-		std::copy_n(&loaderwork.rom[0], l, d);
-	s = l;
-	return l;
+	s = static_cast<int>(std::min<std::size_t>(loaderwork.rom.size(), 0x2000000));
+	return s ? &loaderwork.rom[0] : nullptr;
 }
 
 static struct
@@ -121,11 +118,10 @@ static void MapGSFSection(const std::vector<std::uint8_t> &section, int level)
 	std::uint32_t entry = Get32BitsLE(&section[0]), offset = Get32BitsLE(&section[4]) & 0x1FFFFFF, size = Get32BitsLE(&section[8]), finalSize = size + offset;
 	if (level == 1)
 		loaderwork.entry = entry;
+	// kept at a power of two, as the GBA core mirrors the ROM from this buffer
 	finalSize = NextHighestPowerOf2(finalSize);
-	if (data.empty())
-		data.resize(finalSize + 10, 0);
-	else if (data.size() < size + offset)
-		data.resize(offset + finalSize + 10);
+	if (data.size() < finalSize)
+		data.resize(finalSize);
 	std::copy_n(&section[12], size, &data[offset]);
 }
 
@@ -191,6 +187,8 @@ bool XSFPlayer_GSF::Load()
 		return false;
 
 	cpuIsMultiBoot = (loaderwork.entry >> 24) == 2;
+	// A _gsf_idleskip tag of 0 turns off skipping busy-wait loops for the set
+	cpuIdleSkip = this->xSF->GetTagValue("_gsf_idleskip", 1) != 0;
 
 	CPULoadRom();
 
@@ -232,6 +230,9 @@ void XSFPlayer_GSF::Terminate()
 {
 	soundShutdown();
 
-	loaderwork.rom.clear();
+	// the core reads the ROM out of loaderwork.rom, so drop its pointer before freeing the buffer
+	rom = nullptr;
+	romSize = 0;
+	std::vector<std::uint8_t>().swap(loaderwork.rom);
 	loaderwork.entry = 0;
 }
@@ -1893,7 +1893,6 @@ static INSN_REGPARM void armF00(uint32_t opcode)
 
 // Instruction table //////////////////////////////////////////////////////
 
-typedef INSN_REGPARM void (*insnfunc_t)(uint32_t opcode);
 #define REP16(insn) \
 	insn, insn, insn, insn, insn, insn, insn, insn, \
 	insn, insn, insn, insn, insn, insn, insn, insn
@@ -2083,12 +2082,229 @@ static insnfunc_t armInsnTable[] =
 	REP256(armF00)                                            // F00
 };
 
+// Cached blocks //////////////////////////////////////////////////////////
+
+// Whether the instruction may change PC, CPSR or the CPU state, or raise an
+// exception, so that a cached block has to end with it
+static bool armInsnEndsBlock(uint32_t opcode)
+{
+	int rd = (opcode >> 12) & 15;
+	int rn = (opcode >> 16) & 15;
+	switch ((opcode >> 25) & 7)
+	{
+		case 0:
+			// MRS, MSR, BX and SWP, which raise an exception when malformed
+			if ((opcode & 0x01900000) == 0x01000000)
+				return true;
+			// multiplies write Rn, halfword transfers may write it back
+			if ((opcode & 0x90) == 0x90)
+				return rd == 15 || rn == 15;
+			return rd == 15;
+		case 1:
+			return rd == 15;
+		case 2:
+			// writeback unless pre-indexed without W
+			return rd == 15 || (rn == 15 && (opcode & 0x01200000) != 0x01000000);
+		case 3:
+			return rd == 15 || rn == 15 || (opcode & 0x10);
+		case 4:
+			return (opcode & 0x00408000) || rn == 15;
+		default:
+			return true;
+	}
+}
+
+// Whether the block only loads and computes and then branches back to its
+// start, see CPUExecuteIdleBlock
+static bool armIdleLoop(const cpuCachedBlock *block, uint32_t address)
+{
+	for (int i = 0; i < block->length - 1; ++i)
+	{
+		uint32_t opcode = block->insn[i].opcode;
+		switch ((opcode >> 25) & 7)
+		{
+			case 0:
+				// SWP is the only store here
+				if ((opcode & 0x0FB000F0) == 0x01000090)
+					return false;
+				// halfword transfers
+				if ((opcode & 0x90) == 0x90 && (opcode & 0x60) && !(opcode & 0x00100000))
+					return false;
+				break;
+			case 1:
+				break;
+			case 2:
+			case 3:
+				if (!(opcode & 0x00100000))
+					return false;
+				break;
+			default:
+				return false;
+		}
+	}
+	uint32_t opcode = block->insn[block->length - 1].opcode;
+	if ((opcode & 0x0F000000) != 0x0A000000 || opcode >> 28 == 0x0F)
+		return false;
+	int offset = opcode & 0x00FFFFFF;
+	if (offset & 0x00800000)
+		offset |= 0xFF000000;
+	return address + (block->length - 1) * 4 + 8 + (offset << 2) == address;
+}
+
+static cpuCachedBlock *armGetBlock(uint32_t address)
+{
+	bool valid;
+	cpuCachedBlock *block = CPUGetCachedBlock(address, valid);
+	if (!block || valid)
+		return block;
+
+	// Stop early enough for the prefetched opcodes to stay in the same region
+	int length = 0;
+	int maxLength = CPU_BLOCK_INSNS;
+	if (((address + (CPU_BLOCK_INSNS + 2) * 4 - 1) >> 24) != (address >> 24))
+		maxLength = ((((address >> 24) + 1) << 24) - address) / 4 - 2;
+	for (;;)
+	{
+		uint32_t opcode = CPUReadMemoryQuick(address + length * 4);
+		insnfunc_t func = armInsnTable[((opcode >> 16) & 0xFF0) | ((opcode >> 4) & 0x0F)];
+		block->insn[length].func = func;
+		block->insn[length].opcode = opcode;
+		++length;
+		if (length == maxLength || func == armUnknownInsn || armInsnEndsBlock(opcode))
+			break;
+	}
+	block->length = length;
+	block->idle = armIdleLoop(block, address);
+	for (int i = length; i < length + 2; ++i)
+	{
+		block->insn[i].func = nullptr;
+		block->insn[i].opcode = CPUReadMemoryQuick(address + i * 4);
+	}
+	CPUSetCachedBlockPages(block, address + (length + 2) * 4 - 1);
+	return block;
+}
+
 // Wrapper routine (execution loop) ///////////////////////////////////////
 
+static inline bool armCondition(int cond)
+{
+	switch (cond)
+	{
+		case 0x00: // EQ
+			return Z_FLAG;
+		case 0x01: // NE
+			return !Z_FLAG;
+		case 0x02: // CS
+			return C_FLAG;
+		case 0x03: // CC
+			return !C_FLAG;
+		case 0x04: // MI
+			return N_FLAG;
+		case 0x05: // PL
+			return !N_FLAG;
+		case 0x06: // VS
+			return V_FLAG;
+		case 0x07: // VC
+			return !V_FLAG;
+		case 0x08: // HI
+			return C_FLAG && !Z_FLAG;
+		case 0x09: // LS
+			return !C_FLAG || Z_FLAG;
+		case 0x0A: // GE
+			return N_FLAG == V_FLAG;
+		case 0x0B: // LT
+			return N_FLAG != V_FLAG;
+		case 0x0C: // GT
+			return !Z_FLAG && N_FLAG == V_FLAG;
+		case 0x0D: // LE
+			return Z_FLAG || N_FLAG != V_FLAG;
+		case 0x0E: // AL
+			return true;
+		default:
+			// ???
+			return false;
+	}
+}
+
+// Runs a cached block from its start, following the same steps as the loop
+// in armExecute but taking the opcodes and handlers from the block. Only the
+// last instruction can leave the block, so apart from the tick count the exit
+// conditions are left to armExecute. Nothing but the execution loops reads
+// the prefetch, so it is only filled in on the way out, unless the last
+// instruction branched and refilled it itself.
+static int armExecuteBlock(const cpuCachedBlock *block)
+{
+	const cpuCachedInsn *insn = block->insn;
+	const cpuCachedInsn *end = insn + block->length;
+	uint32_t nextPC;
+	int result = 1;
+	cpuCodeWritten = false;
+	do
+	{
+		if ((armNextPC & 0x0803FFFF) == 0x08020000)
+			busPrefetchCount = 0x100;
+
+		uint32_t opcode = insn->opcode;
+		insnfunc_t func = insn->func;
+		++insn;
+
+		busPrefetch = false;
+		if (busPrefetchCount & 0xFFFFFE00)
+			busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+
+		clockTicks = 0;
+		int oldArmNextPC = armNextPC;
+
+		nextPC = armNextPC = reg[15].I;
+		reg[15].I += 4;
+
+		if (LIKELY(opcode >> 28 == 0x0E) || armCondition(opcode >> 28))
+			(*func)(opcode);
+		if (clockTicks < 0)
+		{
+			result = 0;
+			break;
+		}
+		if (!clockTicks)
+			clockTicks = 1 + codeTicksAccessSeq32(oldArmNextPC);
+		cpuTotalTicks += clockTicks;
+		// a write to cached code ends the block, the following opcodes may be stale
+	} while (insn != end && cpuTotalTicks < cpuNextEvent && !cpuCodeWritten);
+
+	if (armNextPC == nextPC)
+	{
+		cpuPrefetch[0] = insn[0].opcode;
+		cpuPrefetch[1] = insn[1].opcode;
+	}
+	return result;
+}
+
 int armExecute()
 {
+	cpuCachedBlock *block = nullptr;
 	do
 	{
+		// A block that branched back to its own start runs again without a
+		// lookup, as long as no cached code was written in the meantime
+		bool looped = block && block->address == armNextPC && !cpuCodeWritten;
+		if (!looped)
+		{
+			block = armGetBlock(armNextPC);
+			if (block && (block->insn[0].opcode != cpuPrefetch[0] || block->insn[1].opcode != cpuPrefetch[1]))
+				block = nullptr;
+		}
+		if (block)
+		{
+			if (looped && block->idle && cpuIdleSkip)
+			{
+				if (!CPUExecuteIdleBlock(block, armExecuteBlock))
+					return 0;
+			}
+			else if (!armExecuteBlock(block))
+				return 0;
+			continue;
+		}
+
 		if ((armNextPC & 0x0803FFFF) == 0x08020000)
 			busPrefetchCount = 0x100;
 
@@ -2109,59 +2325,7 @@ int armExecute()
 		int cond = opcode >> 28;
 		bool cond_res = true;
 		if (UNLIKELY(cond != 0x0E)) // most opcodes are AL (always)
-		{
-			switch (cond)
-			{
-				case 0x00: // EQ
-					cond_res = Z_FLAG;
-					break;
-				case 0x01: // NE
-					cond_res = !Z_FLAG;
-					break;
-				case 0x02: // CS
-					cond_res = C_FLAG;
-					break;
-				case 0x03: // CC
-					cond_res = !C_FLAG;
-					break;
-				case 0x04: // MI
-					cond_res = N_FLAG;
-					break;
-				case 0x05: // PL
-					cond_res = !N_FLAG;
-					break;
-				case 0x06: // VS
-					cond_res = V_FLAG;
-					break;
-				case 0x07: // VC
-					cond_res = !V_FLAG;
-					break;
-				case 0x08: // HI
-					cond_res = C_FLAG && !Z_FLAG;
-					break;
-				case 0x09: // LS
-					cond_res = !C_FLAG || Z_FLAG;
-					break;
-				case 0x0A: // GE
-					cond_res = N_FLAG == V_FLAG;
-					break;
-				case 0x0B: // LT
-					cond_res = N_FLAG != V_FLAG;
-					break;
-				case 0x0C: // GT
-					cond_res = !Z_FLAG && N_FLAG == V_FLAG;
-					break;
-				case 0x0D: // LE
-					cond_res = Z_FLAG || N_FLAG != V_FLAG;
-					break;
-				case 0x0E: // AL (impossible, checked above)
-					cond_res = true;
-					break;
-				default:
-					// ???
-					cond_res = false;
-			}
-		}
+			cond_res = armCondition(cond);
 
 		if (cond_res)
 			(*armInsnTable[((opcode >> 16) & 0xFF0) | ((opcode >> 4) & 0x0F)])(opcode);
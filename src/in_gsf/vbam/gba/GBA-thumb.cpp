@@ -1417,7 +1417,6 @@ static INSN_REGPARM void thumbF8(uint32_t opcode)
 
 // Instruction table //////////////////////////////////////////////////////
 
-typedef INSN_REGPARM void (*insnfunc_t)(uint32_t opcode);
 #define thumbUI thumbUnknownInsn
 #define thumbBP thumbUnknownInsn
 static insnfunc_t thumbInsnTable[] =
@@ -1552,12 +1551,159 @@ static insnfunc_t thumbInsnTable[] =
 	thumbF8,thumbF8,thumbF8,thumbF8,thumbF8,thumbF8,thumbF8,thumbF8
 };
 
+// Cached blocks //////////////////////////////////////////////////////////
+
+// Whether the instruction may change PC or the CPU state, or raise an
+// exception, so that a cached block has to end with it
+static bool thumbInsnEndsBlock(uint32_t opcode)
+{
+	switch (opcode >> 8)
+	{
+		case 0x44: // ADD Rd, Hs
+		case 0x46: // MOV Rd, Hs
+			return (opcode & 0x87) == 0x87;
+		case 0x47: // BX
+		case 0xBD: // POP {..., PC}
+			return true;
+		default:
+			// conditional branches, SWI, B and the second half of BL
+			return opcode >= 0xD000 && (opcode < 0xF000 || opcode >= 0xF800);
+	}
+}
+
+// Whether the block only loads and computes and then branches back to its
+// start, see CPUExecuteIdleBlock
+static bool thumbIdleLoop(const cpuCachedBlock *block, uint32_t address)
+{
+	for (int i = 0; i < block->length - 1; ++i)
+	{
+		uint32_t op = block->insn[i].opcode >> 8;
+		// shifts, ALU and high register operations, loads other than POP and
+		// LDMIA, and additions to PC and SP
+		if (!(op < 0x50 || (op >= 0x56 && op < 0x60) || (op >= 0x68 && op < 0x70) || (op >= 0x78 && op < 0x80) ||
+			(op >= 0x88 && op < 0x90) || (op >= 0x98 && op <= 0xB0)))
+			return false;
+	}
+	uint32_t opcode = block->insn[block->length - 1].opcode;
+	uint32_t pc = address + (block->length - 1) * 2;
+	int offset;
+	if ((opcode & 0xF000) == 0xD000 && (opcode & 0x0F00) < 0x0E00)
+		offset = static_cast<int8_t>(opcode & 0xFF) << 1;
+	else if ((opcode & 0xF800) == 0xE000)
+	{
+		offset = (opcode & 0x3FF) << 1;
+		if (opcode & 0x0400)
+			offset |= 0xFFFFF800;
+	}
+	else
+		return false;
+	return pc + 4 + offset == address;
+}
+
+static cpuCachedBlock *thumbGetBlock(uint32_t address)
+{
+	bool valid;
+	cpuCachedBlock *block = CPUGetCachedBlock(address | 1, valid);
+	if (!block || valid)
+		return block;
+
+	// Stop early enough for the prefetched opcodes to stay in the same region
+	int length = 0;
+	int maxLength = CPU_BLOCK_INSNS;
+	if (((address + (CPU_BLOCK_INSNS + 2) * 2 - 1) >> 24) != (address >> 24))
+		maxLength = ((((address >> 24) + 1) << 24) - address) / 2 - 2;
+	for (;;)
+	{
+		uint32_t opcode = CPUReadHalfWordQuick(address + length * 2);
+		insnfunc_t func = thumbInsnTable[opcode >> 6];
+		block->insn[length].func = func;
+		block->insn[length].opcode = opcode;
+		++length;
+		if (length == maxLength || func == thumbUnknownInsn || thumbInsnEndsBlock(opcode))
+			break;
+	}
+	block->length = length;
+	block->idle = thumbIdleLoop(block, address);
+	for (int i = length; i < length + 2; ++i)
+	{
+		block->insn[i].func = nullptr;
+		block->insn[i].opcode = CPUReadHalfWordQuick(address + i * 2);
+	}
+	CPUSetCachedBlockPages(block, address + (length + 2) * 2 - 1);
+	return block;
+}
+
 // Wrapper routine (execution loop) ///////////////////////////////////////
 
+// Runs a cached block from its start, see armExecuteBlock
+static int thumbExecuteBlock(const cpuCachedBlock *block)
+{
+	const cpuCachedInsn *insn = block->insn;
+	const cpuCachedInsn *end = insn + block->length;
+	uint32_t nextPC;
+	int result = 1;
+	cpuCodeWritten = false;
+	do
+	{
+		uint32_t opcode = insn->opcode;
+		insnfunc_t func = insn->func;
+		++insn;
+
+		busPrefetch = false;
+		if (busPrefetchCount & 0xFFFFFF00)
+			busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+		clockTicks = 0;
+		uint32_t oldArmNextPC = armNextPC;
+
+		nextPC = armNextPC = reg[15].I;
+		reg[15].I += 2;
+
+		(*func)(opcode);
+
+		if (clockTicks < 0)
+		{
+			result = 0;
+			break;
+		}
+		if (!clockTicks)
+			clockTicks = codeTicksAccessSeq16(oldArmNextPC) + 1;
+		cpuTotalTicks += clockTicks;
+	} while (insn != end && cpuTotalTicks < cpuNextEvent && !cpuCodeWritten);
+
+	if (armNextPC == nextPC)
+	{
+		cpuPrefetch[0] = insn[0].opcode;
+		cpuPrefetch[1] = insn[1].opcode;
+	}
+	return result;
+}
+
 int thumbExecute()
 {
+	cpuCachedBlock *block = nullptr;
 	do
 	{
+		// A block that branched back to its own start runs again without a
+		// lookup, as long as no cached code was written in the meantime
+		bool looped = block && block->address == (armNextPC | 1) && !cpuCodeWritten;
+		if (!looped)
+		{
+			block = thumbGetBlock(armNextPC);
+			if (block && (block->insn[0].opcode != cpuPrefetch[0] || block->insn[1].opcode != cpuPrefetch[1]))
+				block = nullptr;
+		}
+		if (block)
+		{
+			if (looped && block->idle && cpuIdleSkip)
+			{
+				if (!CPUExecuteIdleBlock(block, thumbExecuteBlock))
+					return 0;
+			}
+			else if (!thumbExecuteBlock(block))
+				return 0;
+			continue;
+		}
+
 		//if ((armNextPC & 0x0803FFFF) == 0x08020000)
 		//    busPrefetchCount = 0x100;
 
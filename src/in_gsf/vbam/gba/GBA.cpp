@@ -8,7 +8,7 @@
 #include "bios.h"
 #include "../common/Port.h"
 
-extern int mapgsf(uint8_t *a, int l, int &s);
+extern uint8_t *mapgsf(int &s);
 
 int SWITicks = 0;
 static int IRQTicks = 0;
@@ -30,9 +30,25 @@ bool holdState = false;
 
 uint32_t cpuPrefetch[2];
 
+uint8_t cpuCodePage[CPU_CODE_PAGES];
+static uint32_t cpuCodePageGen[CPU_CODE_PAGES];
+bool cpuCodeWritten = false;
+// Whether busy-wait loops are skipped up to the next event
+bool cpuIdleSkip = true;
+bool cpuTicksRead = false;
+
+// Direct-mapped on the block's start address
+const int CPU_BLOCK_CACHE_SIZE = 4096;
+static cpuCachedBlock cpuBlockCache[CPU_BLOCK_CACHE_SIZE];
+
 int cpuTotalTicks = 0;
 
 static int lcdTicks = 208;
+// Ticks to the next LCD step that sets a bit in IF or starts a DMA. Only those
+// end a CPU slice, the others are carried out once VCOUNT or DISPSTAT is next
+// read or written, see CPUUpdateLcd.
+static int lcdEventTicks = 208;
+bool cpuLcdRead = false;
 static uint8_t timerOnOffDelay = 0;
 static uint16_t timer0Value = 0;
 bool timer0On = false;
@@ -267,11 +283,9 @@ static uint32_t myROM[] =
 	0x03007FE0
 };
 
-static int romSize = 0x2000000;
-
 static inline int CPUUpdateTicks()
 {
-	int cpuLoopTicks = lcdTicks;
+	int cpuLoopTicks = lcdEventTicks;
 
 	if (soundTicks < cpuLoopTicks)
 		cpuLoopTicks = soundTicks;
@@ -296,23 +310,39 @@ static inline int CPUUpdateTicks()
 
 int CPULoadRom()
 {
-	romSize = 0x2000000;
+	int size;
+	uint8_t *data = mapgsf(size);
 
-	memset(&rom[0], 0, 0x2000000);
 	memset(&workRAM[0], 0, 0x40000);
 
+	// the cartridge is read straight from the loader's buffer, a multiboot image is
+	// copied to work RAM instead and leaves the cartridge slot empty
 	if (cpuIsMultiBoot)
-		mapgsf(&workRAM[0], 0x40000, romSize);
+	{
+		rom = nullptr;
+		romSize = 0;
+		size = std::min(size, 0x40000);
+		if (size)
+			memcpy(&workRAM[0], data, size);
+	}
 	else
-		mapgsf(&rom[0], 0x2000000, romSize);
+	{
+		// whole words only, so no read goes past the end of the buffer
+		rom = data;
+		romSize = size & ~3;
+	}
 
-	auto temp = reinterpret_cast<uint16_t *>(&rom[(romSize + 1) & ~1]);
-	for (int i = (romSize + 1) & ~1; i < 0x2000000; i += 2)
+	auto temp = reinterpret_cast<uint16_t *>(&romOpenBus[0]);
+	for (int i = 0; i < 0x20000; i += 2)
 	{
 		WRITE16LE(&temp[0], (i >> 1) & 0xFFFF);
 		++temp;
 	}
 
+	// SWI 0xFA stub at 0x09FE209C, past the end of any ROM but a 32 MB one
+	*reinterpret_cast<uint16_t *>(&romOpenBus[0x209c]) = 0xdffa; // SWI 0xFA
+	*reinterpret_cast<uint16_t *>(&romOpenBus[0x209e]) = 0x4770; // BX LR
+
 	memset(&bios[0], 0, 0x4000);
 	memset(&internalRAM[0], 0, 0x8000);
 	memset(&paletteRAM[0], 0, 0x400);
@@ -320,7 +350,7 @@ int CPULoadRom()
 	memset(&oam[0], 0, 0x400);
 	memset(&ioMem[0], 0, 0x400);
 
-	return romSize;
+	return size;
 }
 
 void CPUUpdateCPSR()
@@ -776,6 +806,8 @@ static void doDMA(uint32_t &s, uint32_t &d, uint32_t si, uint32_t di, uint32_t c
 	}
 
 	cpuDmaTicksToUpdate += totalTicks;
+	// end the CPU slice, so the transfer's ticks count from where it started
+	cpuNextEvent = cpuTotalTicks;
 	cpuDmaHack = false;
 }
 
@@ -948,6 +980,158 @@ void CPUCheckDMA(int reason, int dmamask)
 	}
 }
 
+// Moves the LCD on by one step: into H-Blank, or out of it onto the next line
+static void CPUStepLcd()
+{
+	if (DISPSTAT & 1) // V-BLANK
+	{
+		// if in V-Blank mode, keep computing...
+		if (DISPSTAT & 2)
+		{
+			lcdTicks += 1008;
+			++VCOUNT;
+			UPDATE_REG(0x06, VCOUNT);
+			DISPSTAT &= 0xFFFD;
+			UPDATE_REG(0x04, DISPSTAT);
+			CPUCompareVCOUNT();
+		}
+		else
+		{
+			lcdTicks += 224;
+			DISPSTAT |= 2;
+			UPDATE_REG(0x04, DISPSTAT);
+			if (DISPSTAT & 16)
+			{
+				IF |= 2;
+				UPDATE_REG(0x202, IF);
+			}
+		}
+
+		if (VCOUNT > 227) //Reaching last line
+		{
+			DISPSTAT &= 0xFFFC;
+			UPDATE_REG(0x04, DISPSTAT);
+			VCOUNT = 0;
+			UPDATE_REG(0x06, VCOUNT);
+			CPUCompareVCOUNT();
+		}
+	}
+	else
+	{
+		if (DISPSTAT & 2)
+		{
+			// if in H-Blank, leave it and move to drawing mode
+			++VCOUNT;
+			UPDATE_REG(0x06, VCOUNT);
+
+			lcdTicks += 1008;
+			DISPSTAT &= 0xFFFD;
+			if (VCOUNT == 160)
+			{
+				DISPSTAT |= 1;
+				DISPSTAT &= 0xFFFD;
+				UPDATE_REG(0x04, DISPSTAT);
+				if (DISPSTAT & 0x0008)
+				{
+					IF |= 1;
+					UPDATE_REG(0x202, IF);
+				}
+				CPUCheckDMA(1, 0x0f);
+			}
+
+			UPDATE_REG(0x04, DISPSTAT);
+			CPUCompareVCOUNT();
+		}
+		else
+		{
+			// entering H-Blank
+			DISPSTAT |= 2;
+			UPDATE_REG(0x04, DISPSTAT);
+			lcdTicks += 224;
+			CPUCheckDMA(2, 0x0f);
+			if (DISPSTAT & 16)
+			{
+				IF |= 2;
+				UPDATE_REG(0x202, IF);
+			}
+		}
+	}
+}
+
+// Carries out the LCD steps that are due by now
+void CPUUpdateLcd()
+{
+	while (lcdTicks <= cpuTotalTicks)
+		CPUStepLcd();
+}
+
+// Returns the ticks to the next LCD step that raises an enabled interrupt or
+// starts an enabled DMA, walking the steps of CPUStepLcd without carrying them
+// out. If no step in the next frame does, the LCD is still caught up then.
+static int CPULcdEventTicks()
+{
+	const uint16_t dmaControl[] = { DM0CNT_H, DM1CNT_H, DM2CNT_H, DM3CNT_H };
+	bool vblankDma = false, hblankDma = false;
+	for (uint16_t control : dmaControl)
+		if (control & 0x8000)
+		{
+			vblankDma = vblankDma || ((control >> 12) & 3) == 1;
+			hblankDma = hblankDma || ((control >> 12) & 3) == 2;
+		}
+	bool vblank = (DISPSTAT & 8) || vblankDma;
+	bool hblank = !!(DISPSTAT & 16);
+	int match = DISPSTAT & 0x20 ? DISPSTAT >> 8 : -1;
+
+	int vcount = VCOUNT;
+	bool inVblank = !!(DISPSTAT & 1), inHblank = !!(DISPSTAT & 2);
+	int ticks = lcdTicks;
+	for (int step = 0; step < 2 * 228; ++step)
+	{
+		if (!inHblank)
+		{
+			if (hblank || (!inVblank && hblankDma))
+				return ticks;
+			inHblank = true;
+			ticks += 224;
+			continue;
+		}
+		++vcount;
+		inHblank = false;
+		if (!inVblank && vcount == 160)
+		{
+			if (vblank)
+				return ticks;
+			inVblank = true;
+		}
+		if (vcount == match)
+			return ticks;
+		if (inVblank && vcount > 227)
+		{
+			vcount = 0;
+			inVblank = false;
+			if (!match)
+				return ticks;
+		}
+		ticks += 1008;
+	}
+	return ticks;
+}
+
+// Whether the DMA channel is set to start on V-Blank or H-Blank
+static inline bool CPUDmaOnLcd(uint16_t control)
+{
+	return (control & 0x8000) && (((control >> 12) & 3) == 1 || ((control >> 12) & 3) == 2);
+}
+
+// Called when what the LCD steps raise or start may have changed
+static void CPURescheduleLcd()
+{
+	CPUUpdateLcd();
+	lcdEventTicks = CPULcdEventTicks();
+	if (lcdEventTicks < cpuNextEvent)
+		cpuNextEvent = lcdEventTicks;
+}
+
 void CPUUpdateRegister(uint32_t address, uint16_t value)
 {
 	switch (address)
@@ -976,6 +1160,7 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 
 				if (change && !(value & 0x80))
 				{
+					CPUUpdateLcd();
 					if (!(DISPSTAT & 1))
 					{
 						//lcdTicks = 1008;
@@ -984,13 +1169,16 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 						DISPSTAT &= 0xFFFC;
 						UPDATE_REG(0x04, DISPSTAT);
 						CPUCompareVCOUNT();
+						CPURescheduleLcd();
 					}
 				}
 			}
 			break;
 		case 0x04:
+			CPUUpdateLcd();
 			DISPSTAT = (value & 0xFF38) | (DISPSTAT & 7);
 			UPDATE_REG(0x04, DISPSTAT);
+			CPURescheduleLcd();
 			break;
 		case 0x06:
 			// not writable
@@ -1201,6 +1389,10 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 		case 0xBA:
 			{
 				bool start = !!((DM0CNT_H ^ value) & 0x8000);
+				// the LCD steps up to now happen before the change
+				bool lcd = CPUDmaOnLcd(DM0CNT_H) || CPUDmaOnLcd(value);
+				if (lcd)
+					CPUUpdateLcd();
 				value &= 0xF7E0;
 
 				DM0CNT_H = value;
@@ -1212,6 +1404,8 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 					dma0Dest = DM0DAD_L | (DM0DAD_H << 16);
 					CPUCheckDMA(0, 1);
 				}
+				if (lcd)
+					CPURescheduleLcd();
 			}
 			break;
 		case 0xBC:
@@ -1237,6 +1431,10 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 		case 0xC6:
 			{
 				bool start = !!((DM1CNT_H ^ value) & 0x8000);
+				// the LCD steps up to now happen before the change
+				bool lcd = CPUDmaOnLcd(DM1CNT_H) || CPUDmaOnLcd(value);
+				if (lcd)
+					CPUUpdateLcd();
 				value &= 0xF7E0;
 
 				DM1CNT_H = value;
@@ -1248,6 +1446,8 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 					dma1Dest = DM1DAD_L | (DM1DAD_H << 16);
 					CPUCheckDMA(0, 2);
 				}
+				if (lcd)
+					CPURescheduleLcd();
 			}
 			break;
 		case 0xC8:
@@ -1273,6 +1473,10 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 		case 0xD2:
 			{
 				bool start = !!((DM2CNT_H ^ value) & 0x8000);
+				// the LCD steps up to now happen before the change
+				bool lcd = CPUDmaOnLcd(DM2CNT_H) || CPUDmaOnLcd(value);
+				if (lcd)
+					CPUUpdateLcd();
 				value &= 0xF7E0;
 
 				DM2CNT_H = value;
@@ -1284,6 +1488,8 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 					dma2Dest = DM2DAD_L | (DM2DAD_H << 16);
 					CPUCheckDMA(0, 4);
 				}
+				if (lcd)
+					CPURescheduleLcd();
 			}
 			break;
 		case 0xD4:
@@ -1309,6 +1515,10 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 		case 0xDE:
 			{
 				bool start = !!((DM3CNT_H ^ value) & 0x8000);
+				// the LCD steps up to now happen before the change
+				bool lcd = CPUDmaOnLcd(DM3CNT_H) || CPUDmaOnLcd(value);
+				if (lcd)
+					CPUUpdateLcd();
 				value &= 0xFFE0;
 
 				DM3CNT_H = value;
@@ -1320,6 +1530,8 @@ void CPUUpdateRegister(uint32_t address, uint16_t value)
 					dma3Dest = DM3DAD_L | (DM3DAD_H << 16);
 					CPUCheckDMA(0, 8);
 				}
+				if (lcd)
+					CPURescheduleLcd();
 			}
 			break;
 		case 0x100:
@@ -1478,6 +1690,116 @@ static void applyTimer()
 
 uint8_t cpuBitsSet[256];
 
+static int CPUCodePageOf(uint32_t address)
+{
+	switch (address >> 24)
+	{
+		case 2:
+			return (address & 0x3FFFF) >> 8;
+		case 3:
+			return 0x400 + ((address & 0x7FFF) >> 8);
+		default:
+			return -1;
+	}
+}
+
+void CPUInvalidateCodePage(int page)
+{
+	cpuCodePage[page] = 0;
+	++cpuCodePageGen[page];
+	cpuCodeWritten = true;
+}
+
+// Returns the cache slot for the block at address (with bit 0 set for THUMB
+// code), or nullptr when code there can't be cached. valid tells whether the
+// slot already holds that block; if not, the caller decodes it into the slot.
+cpuCachedBlock *CPUGetCachedBlock(uint32_t address, bool &valid)
+{
+	int region = address >> 24;
+	// Only code that is read-only or whose writes are tracked, and with room
+	// for an instruction and the two prefetched after it before the region ends
+	if ((region != 0 && region != 2 && region != 3 && (region < 8 || region > 0xD)) || ((address + 11) >> 24) != static_cast<uint32_t>(region))
+		return nullptr;
+
+	cpuCachedBlock *block = &cpuBlockCache[((address >> 1) ^ (address >> 13)) & (CPU_BLOCK_CACHE_SIZE - 1)];
+	valid = block->address == address &&
+		(block->page[0] < 0 || block->pageGen[0] == cpuCodePageGen[block->page[0]]) &&
+		(block->page[1] < 0 || block->pageGen[1] == cpuCodePageGen[block->page[1]]);
+	if (!valid)
+		block->address = address;
+	return block;
+}
+
+// Records the pages the block was decoded from, up to and including end
+void CPUSetCachedBlockPages(cpuCachedBlock *block, uint32_t end)
+{
+	block->page[0] = CPUCodePageOf(block->address);
+	block->page[1] = CPUCodePageOf(end);
+	for (int i = 0; i < 2; ++i)
+		if (block->page[i] >= 0)
+		{
+			cpuCodePage[block->page[i]] = 1;
+			block->pageGen[i] = cpuCodePageGen[block->page[i]];
+		}
+}
+
+void CPUFlushCachedBlocks()
+{
+	for (int i = 0; i < CPU_BLOCK_CACHE_SIZE; ++i)
+		cpuBlockCache[i].address = 0xFFFFFFFF;
+	memset(&cpuCodePage[0], 0, sizeof(cpuCodePage));
+	cpuCodeWritten = true;
+}
+
+// Runs a pass of a block that branched back to its own start and may be an
+// idle loop. Such a block only loads, computes and branches, and its loads
+// see the same memory until the next event, so if the pass left the
+// registers, flags and prefetch state as they were, every later pass does
+// too and only adds the same number of ticks. Those passes are skipped, as
+// many as end before the next event, which leaves the last, partial one to
+// run as usual. A pass that changed anything, or read a timer counter, rules
+// the block out until it is decoded again. VCOUNT and DISPSTAT also change at
+// the LCD steps between events, so passes that read them stop short of the
+// next step, and one that differs from the last may have seen a step between
+// them rather than show the block is not idle.
+int CPUExecuteIdleBlock(cpuCachedBlock *block, int (*execute)(const cpuCachedBlock *block))
+{
+	reg_pair before[16];
+	std::copy_n(&reg[0], 16, &before[0]);
+	bool n = N_FLAG, z = Z_FLAG, c = C_FLAG, v = V_FLAG;
+	bool prefetch = busPrefetch;
+	uint32_t prefetchCount = busPrefetchCount;
+	int ticks = cpuTotalTicks;
+	CPUUpdateLcd();
+	int lcdStep = lcdTicks;
+	cpuTicksRead = false;
+	cpuLcdRead = false;
+
+	int result = execute(block);
+	if (!result || armNextPC != (block->address & ~1) || cpuTotalTicks >= cpuNextEvent || cpuCodeWritten)
+		return result;
+	int end = cpuNextEvent;
+	if (cpuLcdRead)
+	{
+		if (cpuTotalTicks >= lcdStep)
+			return result;
+		end = std::min(end, lcdStep);
+	}
+
+	bool same = !cpuTicksRead && n == N_FLAG && z == Z_FLAG && c == C_FLAG && v == V_FLAG && prefetch == busPrefetch && prefetchCount == busPrefetchCount;
+	for (int i = 0; i < 16 && same; ++i)
+		same = before[i].I == reg[i].I;
+	if (!same)
+	{
+		if (!cpuLcdRead)
+			block->idle = false;
+		return result;
+	}
+	int passTicks = cpuTotalTicks - ticks;
+	cpuTotalTicks += (end - cpuTotalTicks - 1) / passTicks * passTicks;
+	return result;
+}
+
 void CPUInit()
 {
 #ifdef WORDS_BIGENDIAN
@@ -1522,16 +1844,12 @@ void CPUInit()
 	std::fill(&ioReadable[0x15c], &ioReadable[0x200], false);
 	std::fill(&ioReadable[0x20c], &ioReadable[0x300], false);
 	std::fill(&ioReadable[0x304], &ioReadable[0x400], false);
-
-	if (romSize < 0x1fe2000)
-	{
-		*reinterpret_cast<uint16_t *>(&rom[0x1fe209c]) = 0xdffa; // SWI 0xFA
-		*reinterpret_cast<uint16_t *>(&rom[0x1fe209e]) = 0x4770; // BX LR
-	}
 }
 
 void CPUReset()
 {
+	// the ROM and memory are reloaded without going through the CPU
+	CPUFlushCachedBlocks();
 	// clean registers
 	memset(&reg[0], 0, sizeof(reg));
 	// clean OAM
@@ -1657,6 +1975,7 @@ void CPUReset()
 	biosProtected[3] = 0xe1;
 
 	lcdTicks = 208;
+	lcdEventTicks = 208;
 	timer0On = false;
 	timer0Ticks = 0;
 	timer0Reload = 0;
@@ -1703,14 +2022,25 @@ void CPUReset()
 	map[6].mask = 0x1FFFF;
 	map[7].address = &oam[0];
 	map[7].mask = 0x3FF;
-	map[8].address = &rom[0];
-	map[8].mask = 0x1FFFFFF;
-	map[9].address = &rom[0];
-	map[9].mask = 0x1FFFFFF;
-	map[10].address = &rom[0];
-	map[10].mask = 0x1FFFFFF;
-	map[12].address = &rom[0];
-	map[12].mask = 0x1FFFFFF;
+	// the ROM is mirrored from its size rounded down to a power of two, only the
+	// reads in GBAinline.h see the open bus past its end, see CPURomAddress
+	uint8_t *romMap = romOpenBus;
+	uint32_t romMask = 0x1FFFF;
+	if (romSize)
+	{
+		romMap = rom;
+		romMask = 0x1FFFFFF;
+		while (romMask >= static_cast<uint32_t>(romSize))
+			romMask >>= 1;
+	}
+	map[8].address = romMap;
+	map[8].mask = romMask;
+	map[9].address = romSize > 0x1000000 ? romMap : romOpenBus;
+	map[9].mask = romSize > 0x1000000 ? romMask : 0x1FFFF;
+	map[10].address = romMap;
+	map[10].mask = romMask;
+	map[12].address = romMap;
+	map[12].mask = romMask;
 
 	soundReset();
 
@@ -1802,82 +2132,11 @@ void CPULoop(int ticks)
 			}
 
 			lcdTicks -= clockTicks;
-
-			if (lcdTicks <= 0)
+			lcdEventTicks -= clockTicks;
+			if (lcdEventTicks <= 0)
 			{
-				if (DISPSTAT & 1) // V-BLANK
-				{
-					// if in V-Blank mode, keep computing...
-					if (DISPSTAT & 2)
-					{
-						lcdTicks += 1008;
-						++VCOUNT;
-						UPDATE_REG(0x06, VCOUNT);
-						DISPSTAT &= 0xFFFD;
-						UPDATE_REG(0x04, DISPSTAT);
-						CPUCompareVCOUNT();
-					}
-					else
-					{
-						lcdTicks += 224;
-						DISPSTAT |= 2;
-						UPDATE_REG(0x04, DISPSTAT);
-						if (DISPSTAT & 16)
-						{
-							IF |= 2;
-							UPDATE_REG(0x202, IF);
-						}
-					}
-
-					if (VCOUNT > 227) //Reaching last line
-					{
-						DISPSTAT &= 0xFFFC;
-						UPDATE_REG(0x04, DISPSTAT);
-						VCOUNT = 0;
-						UPDATE_REG(0x06, VCOUNT);
-						CPUCompareVCOUNT();
-					}
-				}
-				else
-				{
-					if (DISPSTAT & 2)
-					{
-						// if in H-Blank, leave it and move to drawing mode
-						++VCOUNT;
-						UPDATE_REG(0x06, VCOUNT);
-
-						lcdTicks += 1008;
-						DISPSTAT &= 0xFFFD;
-						if (VCOUNT == 160)
-						{
-							DISPSTAT |= 1;
-							DISPSTAT &= 0xFFFD;
-							UPDATE_REG(0x04, DISPSTAT);
-							if (DISPSTAT & 0x0008)
-							{
-								IF |= 1;
-								UPDATE_REG(0x202, IF);
-							}
-							CPUCheckDMA(1, 0x0f);
-						}
-
-						UPDATE_REG(0x04, DISPSTAT);
-						CPUCompareVCOUNT();
-					}
-					else
-					{
-						// entering H-Blank
-						DISPSTAT |= 2;
-						UPDATE_REG(0x04, DISPSTAT);
-						lcdTicks += 224;
-						CPUCheckDMA(2, 0x0f);
-						if (DISPSTAT & 16)
-						{
-							IF |= 2;
-							UPDATE_REG(0x202, IF);
-						}
-					}
-				}
+				CPUUpdateLcd();
+				lcdEventTicks = CPULcdEventTicks();
 			}
 
 			// we shouldn't be doing sound in stop state, but we loose synchronization
@@ -53,6 +53,7 @@ extern bool V_FLAG;
 extern bool armIrqEnable;
 extern bool armState;
 extern int armMode;
+extern bool cpuIdleSkip;
 
 int CPULoadRom();
 void CPUUpdateRegister(uint32_t, uint16_t);
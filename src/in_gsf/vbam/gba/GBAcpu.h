@@ -231,3 +231,41 @@ inline int codeTicksAccessSeq32(uint32_t address) // ARM SEQ
 	else
 		return memoryWaitSeq32[addr];
 }
+
+// Cached interpreter
+//
+// Runs of instructions are decoded once into their opcodes and handlers, so
+// the execution loops can step through them without the prefetch read and the
+// table dispatch. A run ends at the first instruction that may change PC or
+// CPSR. Timing is still worked out per instruction, exactly as the plain loop
+// does it. Blocks from work RAM and internal RAM are dropped when one of their
+// pages is written.
+
+typedef INSN_REGPARM void (*insnfunc_t)(uint32_t opcode);
+
+struct cpuCachedInsn
+{
+	insnfunc_t func;
+	uint32_t opcode;
+};
+
+const int CPU_BLOCK_INSNS = 32;
+
+struct cpuCachedBlock
+{
+	uint32_t address; // of the first instruction, with bit 0 set for THUMB code
+	int length;
+	int page[2];
+	uint32_t pageGen[2];
+	// May be an idle loop, see CPUExecuteIdleBlock
+	bool idle;
+	// Two opcodes past the end, so the prefetch carries on into the next block
+	cpuCachedInsn insn[CPU_BLOCK_INSNS + 2];
+};
+
+extern bool cpuCodeWritten;
+
+cpuCachedBlock *CPUGetCachedBlock(uint32_t address, bool &valid);
+void CPUSetCachedBlockPages(cpuCachedBlock *block, uint32_t end);
+void CPUFlushCachedBlocks();
+int CPUExecuteIdleBlock(cpuCachedBlock *block, int (*execute)(const cpuCachedBlock *block));
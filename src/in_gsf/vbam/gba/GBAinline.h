@@ -23,6 +23,41 @@ extern bool timer3On;
 extern int timer3Ticks;
 extern int timer3ClockReload;
 extern int cpuTotalTicks;
+// Set by reads whose value depends on the tick count, see CPUExecuteIdleBlock
+extern bool cpuTicksRead;
+extern bool cpuLcdRead;
+
+void CPUUpdateLcd();
+
+// VCOUNT and DISPSTAT only move on when read or written, see CPUUpdateLcd
+inline void CPUReadLcd(uint32_t address)
+{
+	if ((address & 0x3fc) == 4)
+	{
+		cpuLcdRead = true;
+		CPUUpdateLcd();
+	}
+}
+
+// One flag per 256-byte page of work RAM (pages 0-0x3FF) and internal RAM
+// (pages 0x400-0x47F), set while a cached CPU block was decoded from the page.
+const int CPU_CODE_PAGES = 0x480;
+extern uint8_t cpuCodePage[CPU_CODE_PAGES];
+
+void CPUInvalidateCodePage(int page);
+
+inline void CPUCheckCodeWrite(int page)
+{
+	if (cpuCodePage[page])
+		CPUInvalidateCodePage(page);
+}
+
+// Past the end of the ROM the cartridge bus returns the low halfword of the address
+inline uint8_t *CPURomAddress(uint32_t address)
+{
+	address &= 0x1FFFFFF;
+	return address < static_cast<uint32_t>(romSize) ? &rom[address] : &romOpenBus[address & 0x1FFFF];
+}
 
 inline uint8_t CPUReadByteQuick(uint32_t addr) { return map[addr >> 24].address[addr & map[addr >> 24].mask]; }
 
@@ -58,6 +93,7 @@ inline uint32_t CPUReadMemory(uint32_t address)
 			value = READ32LE(&internalRAM[address & 0x7ffC]);
 			break;
 		case 4:
+			CPUReadLcd(address);
 			if (address < 0x4000400 && ioReadable[address & 0x3fc])
 			{
 				if (ioReadable[(address & 0x3fc) + 2])
@@ -90,7 +126,7 @@ inline uint32_t CPUReadMemory(uint32_t address)
 		case 10:
 		case 11:
 		case 12:
-			value = READ32LE(&rom[address & 0x1FFFFFC]);
+			value = READ32LE(CPURomAddress(address & 0x1FFFFFC));
 			break;
 		case 13:
 		case 14:
@@ -148,11 +184,13 @@ inline uint32_t CPUReadHalfWord(uint32_t address)
 			value = READ16LE(&internalRAM[address & 0x7ffe]);
 			break;
 		case 4:
+			CPUReadLcd(address);
 			if (address < 0x4000400 && ioReadable[address & 0x3fe])
 			{
 				value = READ16LE(&ioMem[address & 0x3fe]);
 				if ((address & 0x3fe) > 0xFF && (address & 0x3fe) < 0x10E)
 				{
+					cpuTicksRead = true;
 					if ((address & 0x3fe) == 0x100 && timer0On)
 						value = 0xFFFF - ((timer0Ticks - cpuTotalTicks) >> timer0ClockReload);
 					else if ((address & 0x3fe) == 0x104 && timer1On && !(TM1CNT & 4))
@@ -193,7 +231,7 @@ inline uint32_t CPUReadHalfWord(uint32_t address)
 			if (address == 0x80000c4 || address == 0x80000c6 || address == 0x80000c8)
 				value = 0;
 			else
-				value = READ16LE(&rom[address & 0x1FFFFFE]);
+				value = READ16LE(CPURomAddress(address & 0x1FFFFFE));
 			break;
 		case 13:
 		case 14:
@@ -244,6 +282,7 @@ inline uint8_t CPUReadByte(uint32_t address)
 		case 3:
 			return internalRAM[address & 0x7fff];
 		case 4:
+			CPUReadLcd(address);
 			if (address < 0x4000400 && ioReadable[address & 0x3ff])
 				return ioMem[address & 0x3ff];
 			else
@@ -264,7 +303,7 @@ inline uint8_t CPUReadByte(uint32_t address)
 		case 10:
 		case 11:
 		case 12:
-			return rom[address & 0x1FFFFFF];
+			return *CPURomAddress(address);
 		case 13:
 		case 14:
 		case 15:
@@ -289,9 +328,11 @@ inline void CPUWriteMemory(uint32_t address, uint32_t value)
 	{
 		case 0x02:
 			WRITE32LE(&workRAM[address & 0x3FFFC], value);
+			CPUCheckCodeWrite((address & 0x3FFFC) >> 8);
 			break;
 		case 0x03:
 			WRITE32LE(&internalRAM[address & 0x7ffC], value);
+			CPUCheckCodeWrite(0x400 + ((address & 0x7ffC) >> 8));
 			break;
 		case 0x04:
 			if (address < 0x4000400)
@@ -325,9 +366,11 @@ inline void CPUWriteHalfWord(uint32_t address, uint16_t value)
 	{
 		case 2:
 			WRITE16LE(&workRAM[address & 0x3FFFE], value);
+			CPUCheckCodeWrite((address & 0x3FFFE) >> 8);
 			break;
 		case 3:
 			WRITE16LE(&internalRAM[address & 0x7ffe], value);
+			CPUCheckCodeWrite(0x400 + ((address & 0x7ffe) >> 8));
 			break;
 		case 4:
 			if (address < 0x4000400)
@@ -355,9 +398,11 @@ inline void CPUWriteByte(uint32_t address, uint8_t b)
 	{
 		case 2:
 			workRAM[address & 0x3FFFF] = b;
+			CPUCheckCodeWrite((address & 0x3FFFF) >> 8);
 			break;
 		case 3:
 			internalRAM[address & 0x7fff] = b;
+			CPUCheckCodeWrite(0x400 + ((address & 0x7fff) >> 8));
 			break;
 		case 4:
 			if (address < 0x4000400)
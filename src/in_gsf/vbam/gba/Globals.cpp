@@ -16,7 +16,11 @@ int layerSettings = 0xff00;
 int layerEnable = 0xff00;
 
 uint8_t bios[0x4000];
-uint8_t rom[0x2000000];
+// The ROM is the loader's buffer, see CPULoadRom
+uint8_t *rom = nullptr;
+int romSize = 0;
+// What the cartridge bus returns past the end of the ROM, which repeats every 128 KB
+uint8_t romOpenBus[0x20000];
 uint8_t internalRAM[0x8000];
 uint8_t workRAM[0x40000];
 uint8_t paletteRAM[0x400];
@@ -18,7 +18,9 @@ extern int layerSettings;
 extern int layerEnable;
 
 extern uint8_t bios[0x4000];
-extern uint8_t rom[0x2000000];
+extern uint8_t *rom;
+extern int romSize;
+extern uint8_t romOpenBus[0x20000];
 extern uint8_t internalRAM[0x8000];
 extern uint8_t workRAM[0x40000];
 extern uint8_t paletteRAM[0x400];
@@ -9,6 +9,7 @@
 #include "XSFCommon.h"
 
 extern SoundDriver *systemSoundInit();
+extern int cpuTotalTicks;
 
 static const uint32_t NR52 = 0x84;
 
@@ -70,9 +71,11 @@ static std::unique_ptr<Stereo_Buffer> stereo_buffer;
 
 static Blip_Synth<blip_high_quality, 1> pcm_synth[3]; // 32 kHz, 16 kHz, 8 kHz
 
+// soundTicks only moves on at CPU events, so the ticks the CPU has run since
+// the last one are added for writes made in between
 static inline blip_time_t blip_time()
 {
-	return SOUND_CLOCK_TICKS - soundTicks;
+	return SOUND_CLOCK_TICKS - soundTicks + cpuTotalTicks;
 }
 
 inline void Gba_Pcm::init()
@@ -1,6 +1,7 @@
 #include <cmath>
 #include <cstring>
 #include "GBA.h"
+#include "GBAcpu.h"
 #include "bios.h"
 #include "GBAinline.h"
 #include "Globals.h"
@@ -771,6 +772,8 @@ void BIOS_RegisterRamReset(uint32_t flags)
 		if (flags & 0x02)
 			// clear internal RAM
 			memset(&internalRAM[0], 0, 0x7e00); // don't clear 0x7e00-0x7fff
+		if (flags & 0x03)
+			CPUFlushCachedBlocks();
 		if (flags & 0x04)
 			// clear palette RAM
 			memset(&paletteRAM[0], 0, 0x400);
@@ -964,6 +967,7 @@ void BIOS_SoftReset()
 	uint8_t b = internalRAM[0x7ffa];
 
 	memset(&internalRAM[0x7e00], 0, 0x200);
+	CPUFlushCachedBlocks();
 
 	if (b)
 	{
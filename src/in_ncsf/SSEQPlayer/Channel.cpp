@@ -11,7 +11,6 @@
  */
 
 #include <algorithm>
-#include <vector>
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <cstddef>
@@ -51,10 +50,6 @@ TempSndReg::TempSndReg() : CR(0), SOURCE(nullptr), TIMER(0), REPEAT_POINT(0), LE
 {
 }
 
-bool Channel::initializedLUTs = false;
-double Channel::sinc_lut[Channel::SINC_SAMPLES + 1];
-double Channel::window_lut[Channel::SINC_SAMPLES + 1];
-
 #ifndef M_PI
 static const double M_PI = 3.14159265358979323846;
 #endif
@@ -64,22 +59,40 @@ static inline double sinc(double x)
 	return fEqual(x, 0.0) ? 1.0 : std::sin(x * M_PI) / (x * M_PI);
 }
 
-Channel::Channel() : chnId(-1), tempReg(), state(ChannelState::None), trackId(-1), prio(0), manualSweep(false), flags(), pan(0), extAmpl(0), velocity(0), extPan(0),
-	key(0), ampl(0), extTune(0), orgKey(0), modType(0), modSpeed(0), modDepth(0), modRange(0), modDelay(0), modDelayCnt(0), modCounter(0),
-	sweepLen(0), sweepCnt(0), sweepPitch(0), attackLvl(0), sustainLvl(0x7F), decayRate(0), releaseRate(0xFFFF), noteLength(-1), vol(0), ply(nullptr), reg(),
-	ringBuffer()
+/*
+ * Lookup tables for the Sinc interpolation, to avoid the need to call the
+ * sin/cos functions all the time. They will not change between channels or
+ * runs of the program, so there is only one copy, created the first time it
+ * is needed. Initialization of a function-local static is thread-safe, so
+ * multiple players can be created from different threads.
+ */
+struct SincLUTs
 {
-	if (!this->initializedLUTs)
+	double sinc_lut[Channel::SINC_SAMPLES + 1];
+	double window_lut[Channel::SINC_SAMPLES + 1];
+
+	SincLUTs()
 	{
-		double dx = static_cast<double>(SINC_WIDTH) / SINC_SAMPLES, x = 0.0;
-		for (unsigned i = 0; i <= SINC_SAMPLES; ++i, x += dx)
+		double dx = static_cast<double>(Channel::SINC_WIDTH) / Channel::SINC_SAMPLES, x = 0.0;
+		for (unsigned i = 0; i <= Channel::SINC_SAMPLES; ++i, x += dx)
 		{
-			double y = x / SINC_WIDTH;
-			this->sinc_lut[i] = std::abs(x) < SINC_WIDTH ? sinc(x) : 0.0;
+			double y = x / Channel::SINC_WIDTH;
+			this->sinc_lut[i] = std::abs(x) < Channel::SINC_WIDTH ? sinc(x) : 0.0;
 			this->window_lut[i] = 0.40897 + 0.5 * std::cos(M_PI * y) + 0.09103 * std::cos(2 * M_PI * y);
 		}
-		this->initializedLUTs = true;
 	}
+
+	static const SincLUTs &Get()
+	{
+		static const SincLUTs luts;
+		return luts;
+	}
+};
+
+Channel::Channel() : chnId(-1), tempReg(), state(ChannelState::None), trackId(-1), prio(0), manualSweep(false), flags(), pan(0), extAmpl(0), velocity(0), extPan(0),
+	key(0), ampl(0), extTune(0), orgKey(0), modType(0), modSpeed(0), modDepth(0), modRange(0), modDelay(0), modDelayCnt(0), modCounter(0),
+	sweepLen(0), sweepCnt(0), sweepPitch(0), attackLvl(0), sustainLvl(0x7F), decayRate(0), releaseRate(0xFFFF), noteLength(-1), vol(0), ply(nullptr), reg()
+{
 }
 
 // Original FSS Function: Chn_UpdateVol
@@ -611,6 +624,8 @@ static const std::int16_t wavedutytbl[8][8] =
 	{ -0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF }
 };
 
+static_assert(SWAV::GUARD_SAMPLES >= Channel::SINC_WIDTH * 2, "The SWAV guard samples must cover the Sinc interpolation window past the loop wrap point");
+
 // Linear interpolation code originally from DeSmuME
 // Legrange comes from Olli Niemitalo:
 // http://www.student.oulu.fi/~oniemita/dsp/deip.pdf
@@ -619,10 +634,12 @@ std::int32_t Channel::Interpolate()
 	double ratio = this->reg.samplePosition;
 	ratio -= static_cast<std::int32_t>(ratio);
 
-	const auto &data = this->ringBuffer.GetBuffer();
+	// The SWAV has guard samples on both sides, so the points around the current position can be read directly
+	const std::int16_t *data = &this->reg.source->dataptr[static_cast<std::uint32_t>(this->reg.samplePosition)];
 
 	if (this->ply->interpolation == Interpolation::Sinc)
 	{
+		const auto &luts = SincLUTs::Get();
 		double kernel[SINC_WIDTH * 2], kernel_sum = 0.0;
 		int i = SINC_WIDTH, shift = static_cast<int>(std::floor(ratio * SINC_RESOLUTION));
 		int step = this->reg.sampleIncrease > 1.0 ? static_cast<int>(SINC_RESOLUTION / this->reg.sampleIncrease) : SINC_RESOLUTION;
@@ -632,7 +649,7 @@ std::int32_t Channel::Interpolate()
 		{
 			int pos = i * step;
 			int window_pos = i * window_step;
-			kernel_sum += kernel[i + SINC_WIDTH - 1] = this->sinc_lut[std::abs(shift_adj - pos)] * this->window_lut[std::abs(shift - window_pos)];
+			kernel_sum += kernel[i + SINC_WIDTH - 1] = luts.sinc_lut[std::abs(shift_adj - pos)] * luts.window_lut[std::abs(shift - window_pos)];
 		}
 		double sum = 0.0;
 		for (i = 0; i < static_cast<int>(SINC_WIDTH * 2); ++i)
@@ -717,74 +734,22 @@ std::int32_t Channel::GenerateSample()
 
 void Channel::IncrementSample()
 {
-	double samplePosition = this->reg.samplePosition + this->reg.sampleIncrease;
+	this->reg.samplePosition += this->reg.sampleIncrease;
 
 	if (this->reg.format != 3)
 	{
-		if (this->reg.samplePosition < 0 && samplePosition >= 0)
-		{
-			this->ringBuffer.Clear();
-			this->ringBuffer.bufferPos += SINC_WIDTH + 1;
-			auto preData = std::vector<std::int16_t>(SINC_WIDTH + 1, this->reg.source->dataptr[0]);
-			this->ringBuffer.PushSamples(&preData[0], SINC_WIDTH + 1);
-			if (this->reg.totalLength < SINC_WIDTH + 1)
-			{
-				this->ringBuffer.PushSamples(&this->reg.source->dataptr[0], this->reg.totalLength);
-				if (this->reg.repeatMode == 1)
-				{
-					std::size_t samplesLeft = SINC_WIDTH + 1 - this->reg.totalLength;
-					while (samplesLeft)
-					{
-						std::size_t samplesToPush = std::min(samplesLeft, this->reg.length);
-						this->ringBuffer.PushSamples(&this->reg.source->dataptr[this->reg.loopStart], samplesToPush);
-						samplesLeft -= samplesToPush;
-					}
-				}
-			}
-			else
-				this->ringBuffer.PushSamples(&this->reg.source->dataptr[0], SINC_WIDTH + 1);
-		}
-		if (this->reg.samplePosition >= 0)
-		{
-			std::uint32_t loc = static_cast<std::uint32_t>(this->reg.samplePosition) + SINC_WIDTH + 1;
-			std::uint32_t newloc = static_cast<std::uint32_t>(samplePosition) + SINC_WIDTH + 1;
-
-			if (this->reg.repeatMode == 1)
-			{
-				while (loc >= this->reg.totalLength)
-					loc -= this->reg.length;
-				while (newloc >= this->reg.totalLength)
-					newloc -= this->reg.length;
-			}
-
-			while (loc != newloc)
-			{
-				this->ringBuffer.NextSample();
-
-				if (loc < this->reg.totalLength)
-					this->ringBuffer.PushSample(this->reg.source->dataptr[loc++]);
-				else
-				{
-					++loc;
-					this->ringBuffer.PushSample(this->reg.source->dataptr[this->reg.totalLength - 1]);
-				}
-
-				if (this->reg.repeatMode == 1 && loc >= this->reg.totalLength)
-					loc -= this->reg.length;
-			}
-		}
-	}
-
-	this->reg.samplePosition = samplePosition;
-
-	if (this->reg.format != 3 && this->reg.samplePosition >= this->reg.totalLength)
-	{
+		/*
+		 * A looping sample wraps SINC_WIDTH samples after its end instead of
+		 * right at it, the SWAV's guard samples continue the loop there. This
+		 * way the samples before the position are always the end of the loop
+		 * after wrapping, so interpolation stays continuous across the loop.
+		 */
 		if (this->reg.repeatMode == 1)
 		{
-			while (this->reg.samplePosition >= this->reg.totalLength)
+			while (this->reg.samplePosition >= this->reg.totalLength + SINC_WIDTH)
 				this->reg.samplePosition -= this->reg.length;
 		}
-		else
+		else if (this->reg.samplePosition >= this->reg.totalLength)
 			this->Kill();
 	}
 }
@@ -12,9 +12,7 @@
 
 #pragma once
 
-#include <algorithm>
 #include <bitset>
-#include <cstddef>
 #include <cstdint>
 #include "common.h"
 #include "consts.h"
@@ -87,89 +85,6 @@ struct TempSndReg
 
 struct Player;
 
-/*
- * This creates a ring buffer, which will store N samples of SWAV
- * data, duplicated. The way it is duplicated is done as follows:
- * the samples are stored in the center of the buffer, and on both
- * sides is half of the data, the first half being after the data
- * and the second half begin before the data. This in essence
- * mirrors the data while allowing a pointer to always be retrieved
- * and no extra copies of the buffer are created. Part of the idea
- * for this came from kode54's original buffer implementation, but
- * this has been designed to make sure that there are no delays in
- * accessing the SWAVs samples and also doesn't use 0s before the
- * start of the SWAV or use 0s after the end of a non-looping SWAV.
- */
-template<std::size_t N> struct RingBuffer
-{
-	std::int16_t buffer[N * 2];
-	std::size_t bufferPos, getPos;
-
-	RingBuffer() : bufferPos(N / 2), getPos(N / 2)
-	{
-		std::fill_n(&this->buffer[0], N * 2, static_cast<std::int16_t>(0));
-	}
-	void Clear()
-	{
-		std::fill_n(&this->buffer[0], N * 2, static_cast<std::int16_t>(0));
-		this->bufferPos = this->getPos = N / 2;
-	}
-	void PushSample(std::int16_t sample)
-	{
-		this->buffer[this->bufferPos] = sample;
-		if (this->bufferPos >= N)
-			this->buffer[this->bufferPos - N] = sample;
-		else
-			this->buffer[this->bufferPos + N] = sample;
-		++this->bufferPos;
-		if (this->bufferPos >= N * 3 / 2)
-			this->bufferPos -= N;
-	}
-	void PushSamples(const std::int16_t *samples, std::size_t size)
-	{
-		if (this->bufferPos + size > N * 3 / 2)
-		{
-			std::size_t free = N * 3 / 2 - this->bufferPos;
-			std::copy_n(&samples[0], free, &this->buffer[this->bufferPos]);
-			std::copy(&samples[free], &samples[size], &this->buffer[N / 2]);
-		}
-		else
-			std::copy_n(&samples[0], size, &this->buffer[this->bufferPos]);
-		std::size_t rightFree = this->bufferPos < N ? N - this->bufferPos : 0;
-		if (rightFree < size)
-		{
-			if (!rightFree)
-			{
-				std::size_t leftStart = this->bufferPos - N;
-				std::size_t leftSize = std::min(N / 2 - leftStart, size);
-				std::copy_n(&samples[0], leftSize, &this->buffer[leftStart]);
-				if (leftSize < size)
-					std::copy(&samples[leftSize], &samples[size], &this->buffer[N * 3 / 2]);
-			}
-			else
-			{
-				std::copy_n(&samples[0], rightFree, &this->buffer[this->bufferPos + N]);
-				std::copy(&samples[rightFree], &samples[size], &this->buffer[0]);
-			}
-		}
-		else
-			std::copy_n(&samples[0], size, &this->buffer[this->bufferPos + N]);
-		this->bufferPos += size;
-		if (this->bufferPos >= N * 3 / 2)
-			this->bufferPos -= N;
-	}
-	const std::int16_t *GetBuffer() const
-	{
-		return &this->buffer[this->getPos];
-	}
-	void NextSample()
-	{
-		++this->getPos;
-		if (this->getPos >= N * 3 / 2)
-			this->getPos -= N;
-	}
-};
-
 struct Channel
 {
 	std::int8_t chnId;
@@ -214,19 +129,13 @@ struct Channel
 	NDSSoundRegister reg;
 
 	/*
-	 * Lookup tables for the Sinc interpolation, to
-	 * avoid the need to call the sin/cos functions all the time.
-	 * These are static as they will not change between channels or runs
-	 * of the program.
+	 * Sizes of the lookup tables for the Sinc interpolation. The tables
+	 * themselves are built once (in a thread-safe manner) on first use and
+	 * shared between all channels and players, see SincLUTs in Channel.cpp.
 	 */
-	static bool initializedLUTs;
 	static const unsigned SINC_RESOLUTION = 8192;
 	static const unsigned SINC_WIDTH = 8;
 	static const unsigned SINC_SAMPLES = SINC_RESOLUTION * SINC_WIDTH;
-	static double sinc_lut[SINC_SAMPLES + 1];
-	static double window_lut[SINC_SAMPLES + 1];
-
-	RingBuffer<SINC_WIDTH * 2> ringBuffer;
 
 	Channel();
 
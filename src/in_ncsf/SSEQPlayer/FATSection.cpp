@@ -35,6 +35,7 @@ void FATSection::Read(PseudoFile &file)
 		throw std::runtime_error("SDAT FAT Section invalid");
 	file.ReadLE<std::uint32_t>(); // size
 	std::uint32_t count = file.ReadLE<std::uint32_t>();
+	file.CheckRemaining(static_cast<std::uint64_t>(count) * 16);
 	this->records.resize(count);
 	for (std::uint32_t i = 0; i < count; ++i)
 		this->records[i].Read(file);
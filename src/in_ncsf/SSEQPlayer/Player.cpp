@@ -8,15 +8,23 @@
  */
 
 #include <algorithm>
+#include <bitset>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <cstddef>
 #include <cstdint>
 #include "Player.h"
+#include "SBNK.h"
 #include "SSEQ.h"
+#include "SWAR.h"
+#include "SWAV.h"
 #include "common.h"
 #include "consts.h"
 #include "convert.h"
 
-Player::Player() : prio(0), nTracks(0), tempo(0), tempoCount(0), tempoRate(0), masterVol(0), sseqVol(0), sseq(nullptr), allowedChannels(0), sampleRate(0),
-	interpolation(Interpolation::None)
+Player::Player() : prio(0), nTracks(0), tempo(0), tempoCount(0), tempoRate(0), masterVol(0), sseqVol(0), sseq(nullptr), allowedChannels(0), randomState(0x12345678),
+	sampleRate(0), interpolation(Interpolation::None)
 {
 	std::fill_n(&this->trackIds[0], FSS_TRACKCOUNT, static_cast<std::uint8_t>(0));
 	for (std::int8_t i = 0; i < 16; ++i)
@@ -172,3 +180,310 @@ void Player::Timer()
 
 	this->Run();
 }
+
+// The random number generator is kept per-player so that players on different threads do not share state
+std::uint16_t Player::CalcRandom()
+{
+	this->randomState = this->randomState * 1664525 + 1013904223;
+	return static_cast<std::uint16_t>(this->randomState >> 16);
+}
+
+static const std::uint32_t NoStateOffset = std::numeric_limits<std::uint32_t>::max();
+static const std::uint8_t NoStateWaveArc = std::numeric_limits<std::uint8_t>::max();
+
+static void SaveStateDataPointer(std::vector<std::uint8_t> &state, const SSEQ *sseq, const std::uint8_t *ptr)
+{
+	SaveStateValue(state, ptr && sseq ? static_cast<std::uint32_t>(ptr - sseq->data.data()) : NoStateOffset);
+}
+
+static const std::uint8_t *LoadStateDataPointer(PseudoFile &file, const SSEQ *sseq)
+{
+	std::uint32_t offset;
+	LoadStateValue(file, offset);
+	if (offset == NoStateOffset)
+		return nullptr;
+	if (!sseq || offset > sseq->data.size())
+		throw std::range_error("Snapshot refers to a position outside of the SSEQ");
+	return sseq->data.data() + offset;
+}
+
+// SWAVs are stored as the wave archive slot in the bank and the ID of the SWAV within that archive
+static void SaveStateSWAV(std::vector<std::uint8_t> &state, const SSEQ *sseq, const SWAV *swav)
+{
+	if (swav && sseq && sseq->bank)
+		for (std::uint8_t i = 0; i < 4; ++i)
+		{
+			auto swar = sseq->bank->waveArc[i];
+			if (!swar)
+				continue;
+			auto swavEntry = std::find_if(swar->swavs.begin(), swar->swavs.end(), [&](const auto &entry) { return &entry.second == swav; });
+			if (swavEntry != swar->swavs.end())
+			{
+				SaveStateValue(state, i);
+				SaveStateValue(state, swavEntry->first);
+				return;
+			}
+		}
+	SaveStateValue(state, NoStateWaveArc);
+	SaveStateValue(state, NoStateOffset);
+}
+
+static const SWAV *LoadStateSWAV(PseudoFile &file, const SSEQ *sseq)
+{
+	std::uint8_t waveArc;
+	std::uint32_t swavID;
+	LoadStateValue(file, waveArc);
+	LoadStateValue(file, swavID);
+	if (waveArc == NoStateWaveArc)
+		return nullptr;
+	if (!sseq || !sseq->bank || waveArc >= 4 || !sseq->bank->waveArc[waveArc])
+		throw std::range_error("Snapshot refers to a wave archive that is not loaded");
+	return &sseq->bank->waveArc[waveArc]->swavs.at(swavID);
+}
+
+template<std::size_t N> static void SaveStateBits(std::vector<std::uint8_t> &state, const std::bitset<N> &bits)
+{
+	SaveStateValue(state, static_cast<std::uint32_t>(bits.to_ulong()));
+}
+
+template<std::size_t N> static void LoadStateBits(PseudoFile &file, std::bitset<N> &bits)
+{
+	std::uint32_t value;
+	LoadStateValue(file, value);
+	bits = std::bitset<N>(value);
+}
+
+static void SaveTrackState(std::vector<std::uint8_t> &state, const SSEQ *sseq, const Track &trk)
+{
+	SaveStateValue(state, trk.trackId);
+	SaveStateBits(state, trk.state);
+	SaveStateValue(state, trk.num);
+	SaveStateValue(state, trk.prio);
+	SaveStateValue(state, !!trk.ply);
+	SaveStateDataPointer(state, sseq, trk.startPos);
+	SaveStateDataPointer(state, sseq, trk.pos);
+	for (auto &stackValue : trk.stack)
+	{
+		SaveStateValue(state, stackValue.type);
+		SaveStateDataPointer(state, sseq, stackValue.dest);
+	}
+	SaveStateValue(state, trk.stackPos);
+	SaveStateValue(state, trk.loopCount);
+	SaveStateValue(state, trk.overriding);
+	SaveStateValue(state, trk.lastComparisonResult);
+	SaveStateValue(state, trk.wait);
+	SaveStateValue(state, trk.patch);
+	SaveStateValue(state, trk.portaKey);
+	SaveStateValue(state, trk.portaTime);
+	SaveStateValue(state, trk.sweepPitch);
+	SaveStateValue(state, trk.vol);
+	SaveStateValue(state, trk.expr);
+	SaveStateValue(state, trk.pan);
+	SaveStateValue(state, trk.pitchBendRange);
+	SaveStateValue(state, trk.pitchBend);
+	SaveStateValue(state, trk.transpose);
+	SaveStateValue(state, trk.a);
+	SaveStateValue(state, trk.d);
+	SaveStateValue(state, trk.s);
+	SaveStateValue(state, trk.r);
+	SaveStateValue(state, trk.modType);
+	SaveStateValue(state, trk.modSpeed);
+	SaveStateValue(state, trk.modDepth);
+	SaveStateValue(state, trk.modRange);
+	SaveStateValue(state, trk.modDelay);
+	SaveStateBits(state, trk.updateFlags);
+}
+
+static void LoadTrackState(PseudoFile &file, Player *ply, Track &trk)
+{
+	LoadStateValue(file, trk.trackId);
+	LoadStateBits(file, trk.state);
+	LoadStateValue(file, trk.num);
+	LoadStateValue(file, trk.prio);
+	bool hasPlayer;
+	LoadStateValue(file, hasPlayer);
+	trk.ply = hasPlayer ? ply : nullptr;
+	trk.startPos = LoadStateDataPointer(file, ply->sseq);
+	trk.pos = LoadStateDataPointer(file, ply->sseq);
+	for (auto &stackValue : trk.stack)
+	{
+		LoadStateValue(file, stackValue.type);
+		stackValue.dest = LoadStateDataPointer(file, ply->sseq);
+	}
+	LoadStateValue(file, trk.stackPos);
+	LoadStateValue(file, trk.loopCount);
+	LoadStateValue(file, trk.overriding);
+	LoadStateValue(file, trk.lastComparisonResult);
+	LoadStateValue(file, trk.wait);
+	LoadStateValue(file, trk.patch);
+	LoadStateValue(file, trk.portaKey);
+	LoadStateValue(file, trk.portaTime);
+	LoadStateValue(file, trk.sweepPitch);
+	LoadStateValue(file, trk.vol);
+	LoadStateValue(file, trk.expr);
+	LoadStateValue(file, trk.pan);
+	LoadStateValue(file, trk.pitchBendRange);
+	LoadStateValue(file, trk.pitchBend);
+	LoadStateValue(file, trk.transpose);
+	LoadStateValue(file, trk.a);
+	LoadStateValue(file, trk.d);
+	LoadStateValue(file, trk.s);
+	LoadStateValue(file, trk.r);
+	LoadStateValue(file, trk.modType);
+	LoadStateValue(file, trk.modSpeed);
+	LoadStateValue(file, trk.modDepth);
+	LoadStateValue(file, trk.modRange);
+	LoadStateValue(file, trk.modDelay);
+	LoadStateBits(file, trk.updateFlags);
+}
+
+static void SaveChannelState(std::vector<std::uint8_t> &state, const SSEQ *sseq, const Channel &chn)
+{
+	SaveStateValue(state, chn.tempReg.CR);
+	SaveStateSWAV(state, sseq, chn.tempReg.SOURCE);
+	SaveStateValue(state, chn.tempReg.TIMER);
+	SaveStateValue(state, chn.tempReg.REPEAT_POINT);
+	SaveStateValue(state, chn.tempReg.LENGTH);
+	SaveStateValue(state, chn.state);
+	SaveStateValue(state, chn.trackId);
+	SaveStateValue(state, chn.prio);
+	SaveStateValue(state, chn.manualSweep);
+	SaveStateBits(state, chn.flags);
+	SaveStateValue(state, chn.pan);
+	SaveStateValue(state, chn.extAmpl);
+	SaveStateValue(state, chn.velocity);
+	SaveStateValue(state, chn.extPan);
+	SaveStateValue(state, chn.key);
+	SaveStateValue(state, chn.ampl);
+	SaveStateValue(state, chn.extTune);
+	SaveStateValue(state, chn.orgKey);
+	SaveStateValue(state, chn.modType);
+	SaveStateValue(state, chn.modSpeed);
+	SaveStateValue(state, chn.modDepth);
+	SaveStateValue(state, chn.modRange);
+	SaveStateValue(state, chn.modDelay);
+	SaveStateValue(state, chn.modDelayCnt);
+	SaveStateValue(state, chn.modCounter);
+	SaveStateValue(state, chn.sweepLen);
+	SaveStateValue(state, chn.sweepCnt);
+	SaveStateValue(state, chn.sweepPitch);
+	SaveStateValue(state, chn.attackLvl);
+	SaveStateValue(state, chn.sustainLvl);
+	SaveStateValue(state, chn.decayRate);
+	SaveStateValue(state, chn.releaseRate);
+	SaveStateValue(state, chn.noteLength);
+	SaveStateValue(state, chn.vol);
+
+	SaveStateValue(state, chn.reg.volumeMul);
+	SaveStateValue(state, chn.reg.volumeDiv);
+	SaveStateValue(state, chn.reg.panning);
+	SaveStateValue(state, chn.reg.waveDuty);
+	SaveStateValue(state, chn.reg.repeatMode);
+	SaveStateValue(state, chn.reg.format);
+	SaveStateValue(state, chn.reg.enable);
+	SaveStateSWAV(state, sseq, chn.reg.source);
+	SaveStateValue(state, chn.reg.timer);
+	SaveStateValue(state, chn.reg.psgX);
+	SaveStateValue(state, chn.reg.psgLast);
+	SaveStateValue(state, chn.reg.psgLastCount);
+	SaveStateValue(state, chn.reg.samplePosition);
+	SaveStateValue(state, chn.reg.sampleIncrease);
+	SaveStateValue(state, chn.reg.loopStart);
+	SaveStateValue(state, chn.reg.length);
+	SaveStateValue(state, chn.reg.totalLength);
+}
+
+static void LoadChannelState(PseudoFile &file, const SSEQ *sseq, Channel &chn)
+{
+	LoadStateValue(file, chn.tempReg.CR);
+	chn.tempReg.SOURCE = LoadStateSWAV(file, sseq);
+	LoadStateValue(file, chn.tempReg.TIMER);
+	LoadStateValue(file, chn.tempReg.REPEAT_POINT);
+	LoadStateValue(file, chn.tempReg.LENGTH);
+	LoadStateValue(file, chn.state);
+	LoadStateValue(file, chn.trackId);
+	LoadStateValue(file, chn.prio);
+	LoadStateValue(file, chn.manualSweep);
+	LoadStateBits(file, chn.flags);
+	LoadStateValue(file, chn.pan);
+	LoadStateValue(file, chn.extAmpl);
+	LoadStateValue(file, chn.velocity);
+	LoadStateValue(file, chn.extPan);
+	LoadStateValue(file, chn.key);
+	LoadStateValue(file, chn.ampl);
+	LoadStateValue(file, chn.extTune);
+	LoadStateValue(file, chn.orgKey);
+	LoadStateValue(file, chn.modType);
+	LoadStateValue(file, chn.modSpeed);
+	LoadStateValue(file, chn.modDepth);
+	LoadStateValue(file, chn.modRange);
+	LoadStateValue(file, chn.modDelay);
+	LoadStateValue(file, chn.modDelayCnt);
+	LoadStateValue(file, chn.modCounter);
+	LoadStateValue(file, chn.sweepLen);
+	LoadStateValue(file, chn.sweepCnt);
+	LoadStateValue(file, chn.sweepPitch);
+	LoadStateValue(file, chn.attackLvl);
+	LoadStateValue(file, chn.sustainLvl);
+	LoadStateValue(file, chn.decayRate);
+	LoadStateValue(file, chn.releaseRate);
+	LoadStateValue(file, chn.noteLength);
+	LoadStateValue(file, chn.vol);
+
+	LoadStateValue(file, chn.reg.volumeMul);
+	LoadStateValue(file, chn.reg.volumeDiv);
+	LoadStateValue(file, chn.reg.panning);
+	LoadStateValue(file, chn.reg.waveDuty);
+	LoadStateValue(file, chn.reg.repeatMode);
+	LoadStateValue(file, chn.reg.format);
+	LoadStateValue(file, chn.reg.enable);
+	chn.reg.source = LoadStateSWAV(file, sseq);
+	LoadStateValue(file, chn.reg.timer);
+	LoadStateValue(file, chn.reg.psgX);
+	LoadStateValue(file, chn.reg.psgLast);
+	LoadStateValue(file, chn.reg.psgLastCount);
+	LoadStateValue(file, chn.reg.samplePosition);
+	LoadStateValue(file, chn.reg.sampleIncrease);
+	LoadStateValue(file, chn.reg.loopStart);
+	LoadStateValue(file, chn.reg.length);
+	LoadStateValue(file, chn.reg.totalLength);
+}
+
+void Player::SaveState(std::vector<std::uint8_t> &state) const
+{
+	state.clear();
+	SaveStateValue(state, this->prio);
+	SaveStateValue(state, this->nTracks);
+	SaveStateValue(state, this->tempo);
+	SaveStateValue(state, this->tempoCount);
+	SaveStateValue(state, this->tempoRate);
+	SaveStateValue(state, this->masterVol);
+	SaveStateValue(state, this->sseqVol);
+	SaveStateValue(state, this->trackIds);
+	for (auto &trk : this->tracks)
+		SaveTrackState(state, this->sseq, trk);
+	for (auto &chn : this->channels)
+		SaveChannelState(state, this->sseq, chn);
+	SaveStateBits(state, this->allowedChannels);
+	SaveStateValue(state, this->variables);
+	SaveStateValue(state, this->randomState);
+}
+
+void Player::LoadState(PseudoFile &file)
+{
+	LoadStateValue(file, this->prio);
+	LoadStateValue(file, this->nTracks);
+	LoadStateValue(file, this->tempo);
+	LoadStateValue(file, this->tempoCount);
+	LoadStateValue(file, this->tempoRate);
+	LoadStateValue(file, this->masterVol);
+	LoadStateValue(file, this->sseqVol);
+	LoadStateValue(file, this->trackIds);
+	for (auto &trk : this->tracks)
+		LoadTrackState(file, this, trk);
+	for (auto &chn : this->channels)
+		LoadChannelState(file, this->sseq, chn);
+	LoadStateBits(file, this->allowedChannels);
+	LoadStateValue(file, this->variables);
+	LoadStateValue(file, this->randomState);
+}
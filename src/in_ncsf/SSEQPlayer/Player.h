@@ -10,12 +10,14 @@
 #pragma once
 
 #include <bitset>
+#include <vector>
 #include <cstdint>
 #include "Channel.h"
 #include "Track.h"
 #include "consts.h"
 
 enum class ChannelAllocateType;
+struct PseudoFile;
 struct SSEQ;
 
 struct Player
@@ -31,6 +33,7 @@ struct Player
 	Channel channels[16];
 	std::bitset<16> allowedChannels;
 	std::int16_t variables[32];
+	std::uint32_t randomState;
 
 	std::uint32_t sampleRate;
 	Interpolation interpolation;
@@ -46,4 +49,13 @@ struct Player
 	void Run();
 	void UpdateTracks();
 	void Timer();
+	std::uint16_t CalcRandom();
+
+	/*
+	 * Snapshots of everything that changes during playback. Pointers into
+	 * the SSEQ and the SWAVs are stored as offsets and indices, so a
+	 * snapshot stays valid as long as the same SSEQ is being played.
+	 */
+	void SaveState(std::vector<std::uint8_t> &state) const;
+	void LoadState(PseudoFile &file);
 };
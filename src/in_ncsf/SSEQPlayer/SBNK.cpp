@@ -101,6 +101,7 @@ void SBNK::Read(PseudoFile &file)
 	std::uint32_t reserved[8];
 	file.ReadLE(reserved);
 	std::uint32_t count = file.ReadLE<std::uint32_t>();
+	file.CheckRemaining(static_cast<std::uint64_t>(count) * 4);
 	this->entries.resize(count);
 	for (std::uint32_t i = 0; i < count; ++i)
 		this->entries[i].Read(file, startOfSBNK);
@@ -56,8 +56,8 @@ SDAT::SDAT(PseudoFile &file, std::uint32_t sseqToLoad) : sseq(), sbnk(), player(
 		std::uint32_t fileID = infoSection.SEQrecord.entries[sseqToLoad].fileID;
 		std::string name = "SSEQ" + NumToHexString(fileID).substr(2);
 		if (SYMBOffset)
-			name = NumToHexString(sseqToLoad).substr(6) + " - " + symbSection.SEQrecord.entries[sseqToLoad];
-		file.pos = fatSection.records[fileID].offset;
+			name = NumToHexString(sseqToLoad).substr(6) + " - " + std::string(symbSection.SEQrecord.entries[sseqToLoad]);
+		file.pos = fatSection.records.at(fileID).offset;
 		SSEQ *newSSEQ = new SSEQ(name);
 		newSSEQ->info = infoSection.SEQrecord.entries[sseqToLoad];
 		newSSEQ->Read(file);
@@ -68,8 +68,8 @@ SDAT::SDAT(PseudoFile &file, std::uint32_t sseqToLoad) : sseq(), sbnk(), player(
 		fileID = infoSection.BANKrecord.entries[bank].fileID;
 		name = "SBNK" + NumToHexString(fileID).substr(2);
 		if (SYMBOffset)
-			name = NumToHexString(bank).substr(2) + " - " + symbSection.BANKrecord.entries[bank];
-		file.pos = fatSection.records[fileID].offset;
+			name = NumToHexString(bank).substr(2) + " - " + std::string(symbSection.BANKrecord.entries[bank]);
+		file.pos = fatSection.records.at(fileID).offset;
 		SBNK *newSBNK = new SBNK(name);
 		newSSEQ->bank = newSBNK;
 		newSBNK->info = infoSection.BANKrecord.entries[bank];
@@ -84,8 +84,8 @@ SDAT::SDAT(PseudoFile &file, std::uint32_t sseqToLoad) : sseq(), sbnk(), player(
 				fileID = infoSection.WAVEARCrecord.entries[waveArc].fileID;
 				name = "SWAR" + NumToHexString(fileID).substr(2);
 				if (SYMBOffset)
-					name = NumToHexString(waveArc).substr(2) + " - " + symbSection.WAVEARCrecord.entries[waveArc];
-				file.pos = fatSection.records[fileID].offset;
+					name = NumToHexString(waveArc).substr(2) + " - " + std::string(symbSection.WAVEARCrecord.entries[waveArc]);
+				file.pos = fatSection.records.at(fileID).offset;
 				SWAR *newSWAR = new SWAR(name);
 				newSBNK->waveArc[i] = newSWAR;
 				newSWAR->info = infoSection.WAVEARCrecord.entries[waveArc];
@@ -29,6 +29,8 @@ void SSEQ::Read(PseudoFile &file)
 		throw std::runtime_error("SSEQ DATA structure invalid");
 	std::uint32_t size = file.ReadLE<std::uint32_t>();
 	std::uint32_t dataOffset = file.ReadLE<std::uint32_t>();
+	if (size < 12)
+		throw std::runtime_error("SSEQ DATA structure invalid");
 	this->data.resize(size - 12, 0);
 	file.pos = startOfSSEQ + dataOffset;
 	file.ReadLE(this->data);
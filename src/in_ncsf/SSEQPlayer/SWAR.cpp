@@ -33,8 +33,7 @@ void SWAR::Read(PseudoFile &file)
 	std::uint32_t reserved[8];
 	file.ReadLE(reserved);
 	std::uint32_t count = file.ReadLE<std::uint32_t>();
-	auto offsets = std::vector<std::uint32_t>(count);
-	file.ReadLE(offsets);
+	auto offsets = file.ReadLEVector<std::uint32_t>(count);
 	for (std::uint32_t i = 0; i < count; ++i)
 		if (offsets[i])
 		{
@@ -6,9 +6,12 @@
  * http://www.feshrine.net/hacking/doc/nds-sdat.html
  */
 
+#include <algorithm>
+#include <stdexcept>
 #include <vector>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include "SWAV.h"
 #include "common.h"
 
@@ -69,7 +72,7 @@ void SWAV::DecodeADPCM(const std::uint8_t *origData, std::uint32_t len)
 {
 	std::int32_t predictedValue = origData[0] | (origData[1] << 8);
 	std::int32_t stepIndex = origData[2] | (origData[3] << 8);
-	auto finalData = &this->data[0];
+	auto finalData = &this->data[GUARD_SAMPLES];
 
 	for (std::uint32_t i = 0; i < len; ++i)
 	{
@@ -91,38 +94,72 @@ void SWAV::Read(PseudoFile &file)
 	this->time = file.ReadLE<std::uint16_t>();
 	this->loopOffset = file.ReadLE<std::uint16_t>();
 	this->nonLoopLength = file.ReadLE<std::uint32_t>();
-	std::uint32_t size = (this->loopOffset + this->nonLoopLength) * 4;
-	auto origData = std::vector<std::uint8_t>(size);
-	file.ReadLE(origData);
+	std::uint64_t fullSize = (static_cast<std::uint64_t>(this->loopOffset) + this->nonLoopLength) * 4;
+	// The sample data is used in place, ReadBytes will throw if the SWAV is truncated
+	auto origData = file.ReadBytes(fullSize);
+	auto size = static_cast<std::uint32_t>(fullSize);
 
-	// Convert data accordingly
+	// Convert data accordingly, the sample lengths need to be known before the data is allocated
 	if (!this->waveType)
 	{
 		// PCM 8-bit -> PCM signed 16-bit
-		this->data.resize(size, 0);
-		for (std::size_t i = 0; i < size; ++i)
-			this->data[i] = origData[i] << 8;
 		this->loopOffset *= 4;
 		this->nonLoopLength *= 4;
+		this->AllocateData(size);
+		for (std::size_t i = 0; i < size; ++i)
+			this->data[GUARD_SAMPLES + i] = origData[i] << 8;
 	}
 	else if (this->waveType == 1)
 	{
 		// PCM signed 16-bit, no conversion
-		this->data.resize(size / 2, 0);
-		for (std::size_t i = 0; i < size / 2; ++i)
-			this->data[i] = ReadLE<std::int16_t>(&origData[2 * i]);
 		this->loopOffset *= 2;
 		this->nonLoopLength *= 2;
+		this->AllocateData(size / 2);
+		if (size)
+			std::memcpy(&this->data[GUARD_SAMPLES], origData, size);
+		if constexpr (!NativeLittleEndian)
+			for (std::uint32_t i = 0; i < size / 2; ++i)
+				this->data[GUARD_SAMPLES + i] = FromLE(this->data[GUARD_SAMPLES + i]);
 	}
 	else if (this->waveType == 2)
 	{
 		// IMA ADPCM -> PCM signed 16-bit
-		this->data.resize((size - 4) * 2, 0);
-		this->DecodeADPCM(&origData[0], size - 4);
+		if (size < 4)
+			throw std::runtime_error("SWAV ADPCM header missing");
 		if (this->loopOffset)
 			--this->loopOffset;
 		this->loopOffset *= 8;
 		this->nonLoopLength *= 8;
+		this->AllocateData((size - 4) * 2);
+		this->DecodeADPCM(origData, size - 4);
+	}
+	else
+		this->AllocateData(0);
+	this->AddGuardSamples();
+}
+
+/*
+ * Allocates room for the decoded samples and the guard samples. The looping
+ * information may describe more samples than were decoded (an ADPCM SWAV
+ * without a loop offset does), those extra samples are left as silence.
+ */
+void SWAV::AllocateData(std::uint32_t decodedSamples)
+{
+	std::uint32_t totalLength = std::max(decodedSamples, this->loopOffset + this->nonLoopLength);
+	this->data.assign(GUARD_SAMPLES + totalLength + GUARD_SAMPLES, 0);
+}
+
+void SWAV::AddGuardSamples()
+{
+	std::uint32_t totalLength = this->loopOffset + this->nonLoopLength;
+	auto samples = &this->data[GUARD_SAMPLES];
+	std::fill_n(&this->data[0], GUARD_SAMPLES, totalLength ? samples[0] : 0);
+	for (std::uint32_t i = 0; i < GUARD_SAMPLES; ++i)
+	{
+		if (this->loop && this->nonLoopLength)
+			samples[totalLength + i] = samples[this->loopOffset + i % this->nonLoopLength];
+		else
+			samples[totalLength + i] = totalLength ? samples[totalLength - 1] : 0;
 	}
-	this->dataptr = &this->data[0];
+	this->dataptr = samples;
 }
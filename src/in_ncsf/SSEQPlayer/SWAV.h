@@ -21,11 +21,21 @@ struct SWAV
 	std::uint16_t time;
 	std::uint32_t loopOffset;
 	std::uint32_t nonLoopLength;
+	/*
+	 * The decoded samples are surrounded by guard samples so the player can
+	 * interpolate around any position without bounds checks or copying:
+	 * GUARD_SAMPLES copies of the first sample come before the SWAV, and
+	 * after it is GUARD_SAMPLES more of the loop (or of the last sample for
+	 * a non-looping SWAV). dataptr points to the first actual sample.
+	 */
+	static const unsigned GUARD_SAMPLES = 16;
 	std::vector<std::int16_t> data;
 	const std::int16_t *dataptr;
 
 	SWAV();
 
 	void Read(PseudoFile &file);
+	void AllocateData(std::uint32_t decodedSamples);
 	void DecodeADPCM(const std::uint8_t *origData, std::uint32_t len);
+	void AddGuardSamples();
 };
@@ -19,8 +19,7 @@ SYMBRecord::SYMBRecord() : entries()
 void SYMBRecord::Read(PseudoFile &file, std::uint32_t startOffset)
 {
 	std::uint32_t count = file.ReadLE<std::uint32_t>();
-	auto entryOffsets = std::vector<std::uint32_t>(count);
-	file.ReadLE(entryOffsets);
+	auto entryOffsets = file.ReadLEVector<std::uint32_t>(count);
 	for (std::uint32_t i = 0; i < count; ++i)
 		if (entryOffsets[i])
 		{
@@ -9,13 +9,14 @@
 #pragma once
 
 #include <map>
+#include <string_view>
 #include <cstdint>
 
 struct PseudoFile;
 
 struct SYMBRecord
 {
-	std::map<std::uint32_t, std::string> entries;
+	std::map<std::uint32_t, std::string_view> entries; // Views into the SDAT data
 
 	SYMBRecord();
 
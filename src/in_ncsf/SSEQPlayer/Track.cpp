@@ -408,14 +408,6 @@ static inline std::uint8_t SseqCommandByteCount(int cmd)
 		}
 }
 
-static std::uint32_t RandomU{ 0x12345678 };
-
-static std::uint16_t CalcRandom()
-{
-	RandomU = RandomU * 1664525 + 1013904223;
-	return static_cast<std::uint16_t>(RandomU >> 16);
-}
-
 static auto varFuncSet = [](std::int16_t, std::int16_t value) { return value; };
 static auto varFuncAdd = [](std::int16_t var, std::int16_t value) -> std::int16_t { return var + value; };
 static auto varFuncSub = [](std::int16_t var, std::int16_t value) -> std::int16_t { return var - value; };
@@ -428,15 +420,7 @@ static auto varFuncShift = [](std::int16_t var, std::int16_t value) -> std::int1
 	else
 		return var << value;
 };
-static auto varFuncRand = [](std::int16_t, std::int16_t value) -> std::int16_t
-{
-	if (value < 0)
-		return -(CalcRandom() % (-value + 1));
-	else
-		return CalcRandom() % (value + 1);
-};
-
-static inline std::function<std::int16_t (std::int16_t, std::int16_t)> VarFunc(int cmd)
+static inline std::function<std::int16_t (std::int16_t, std::int16_t)> VarFunc(int cmd, Player *ply)
 {
 	switch (static_cast<SSEQCommand>(cmd))
 	{
@@ -453,7 +437,13 @@ static inline std::function<std::int16_t (std::int16_t, std::int16_t)> VarFunc(i
 		case SSEQCommand::ShiftVariable:
 			return varFuncShift;
 		case SSEQCommand::RandomVariable:
-			return varFuncRand;
+			return [ply](std::int16_t, std::int16_t value) -> std::int16_t
+			{
+				if (value < 0)
+					return -(ply->CalcRandom() % (-value + 1));
+				else
+					return ply->CalcRandom() % (value + 1);
+			};
 		default:
 			return nullptr;
 	}
@@ -745,7 +735,7 @@ void Track::Run()
 						this->overriding.extraValue = read8(pData);
 					std::int16_t minVal = static_cast<std::int16_t>(read16(pData));
 					std::int16_t maxVal = static_cast<std::int16_t>(read16(pData));
-					this->overriding.value = (CalcRandom() % (maxVal - minVal + 1)) + minVal;
+					this->overriding.value = (this->ply->CalcRandom() % (maxVal - minVal + 1)) + minVal;
 					break;
 				}
 
@@ -773,7 +763,7 @@ void Track::Run()
 					value = this->overriding.val<std::int16_t>(pData, read16);
 					if (cmd == ConvertFuncs::ToIntegral(SSEQCommand::DivideVariable) && !value) // Division by 0, skip it to prevent crashing
 						break;
-					this->ply->variables[varNo] = VarFunc(cmd)(this->ply->variables[varNo], static_cast<std::int16_t>(value));
+					this->ply->variables[varNo] = VarFunc(cmd, this->ply)(this->ply->variables[varNo], static_cast<std::int16_t>(value));
 					break;
 				}
 
@@ -10,85 +10,163 @@
 #pragma once
 
 #include <algorithm>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 #include <cstring>
 #include <cstddef>
 #include <cstdint>
 
+/*
+ * Byte order handling
+ *
+ * All SDAT data is little-endian. The readers below load values with
+ * std::memcpy (which is safe for unaligned data and compiles down to a plain
+ * load), only swapping the bytes afterwards on big-endian hosts.
+ */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline constexpr bool NativeLittleEndian = false;
+#else
+inline constexpr bool NativeLittleEndian = true;
+#endif
+
+template<typename T> inline typename std::enable_if_t<std::is_integral_v<T>, T> FromLE(T val)
+{
+	if constexpr (NativeLittleEndian || sizeof(T) == 1)
+		return val;
+	else
+	{
+		std::uint8_t bytes[sizeof(T)];
+		std::memcpy(&bytes[0], &val, sizeof(T));
+		std::reverse(&bytes[0], &bytes[sizeof(T)]);
+		std::memcpy(&val, &bytes[0], sizeof(T));
+		return val;
+	}
+}
+
+/*
+ * Data Reading
+ *
+ * The following ReadLE function will read from an array (sent in as a
+ * pointer), while making sure that the data is read in as little-endian
+ * formating. The caller is responsible for making sure there is enough data.
+ */
+
+template<typename T> inline typename std::enable_if_t<std::is_integral_v<T>, T> ReadLE(const std::uint8_t *arr)
+{
+	T finalVal;
+	std::memcpy(&finalVal, arr, sizeof(T));
+	return FromLE(finalVal);
+}
+
 /*
  * Pseudo-file data structure
+ *
+ * This is a read-only view over the SDAT data, it does not own or copy it, so
+ * the data must outlive anything read from it (including the string views
+ * returned by ReadNullTerminatedString). Every read is checked against the
+ * size of the data and will throw if it would go past the end, so a
+ * truncated or malformed SDAT results in an exception instead of reading
+ * beyond the buffer.
  */
 struct PseudoFile
 {
-	std::vector<std::uint8_t> *data;
+	const std::uint8_t *data;
+	std::size_t size;
 	std::uint32_t pos;
 
-	PseudoFile() : data(nullptr), pos(0)
+	PseudoFile() : data(nullptr), size(0), pos(0)
+	{
+	}
+
+	PseudoFile(const std::vector<std::uint8_t> &vec) : data(vec.data()), size(vec.size()), pos(0)
 	{
 	}
 
+	void CheckRemaining(std::uint64_t bytes) const
+	{
+		if (this->pos > this->size || bytes > this->size - this->pos)
+			throw std::range_error("Attempted to read past the end of the SDAT (offset " + std::to_string(this->pos) + ", " + std::to_string(bytes) + " bytes)");
+	}
+
+	const std::uint8_t *ReadBytes(std::uint64_t bytes)
+	{
+		this->CheckRemaining(bytes);
+		auto ptr = this->data + this->pos;
+		this->pos += static_cast<std::uint32_t>(bytes);
+		return ptr;
+	}
+
 	template<typename T> typename std::enable_if_t<std::is_integral_v<T>, T> ReadLE()
 	{
-		T finalVal = 0;
-		for (std::size_t i = 0; i < sizeof(T); ++i)
-			finalVal |= (*this->data)[this->pos++] << (i * 8);
-		return finalVal;
+		return ::ReadLE<T>(this->ReadBytes(sizeof(T)));
 	}
 
-	template<typename T, std::size_t N> typename std::enable_if_t<std::is_integral_v<T>> ReadLE(T (&arr)[N])
+	template<typename T> typename std::enable_if_t<std::is_integral_v<T>> ReadLE(T *arr, std::size_t count)
 	{
-		for (std::size_t i = 0; i < N; ++i)
-			arr[i] = this->ReadLE<T>();
+		auto src = this->ReadBytes(static_cast<std::uint64_t>(count) * sizeof(T));
+		if (count)
+			std::memcpy(arr, src, count * sizeof(T));
+		if constexpr (!NativeLittleEndian && sizeof(T) > 1)
+			for (std::size_t i = 0; i < count; ++i)
+				arr[i] = FromLE(arr[i]);
 	}
 
-	template<std::size_t N> void ReadLE(std::uint8_t arr[N])
+	template<typename T, std::size_t N> typename std::enable_if_t<std::is_integral_v<T>> ReadLE(T (&arr)[N])
 	{
-		std::copy_n(&(*this->data)[this->pos], N, &arr[0]);
-		this->pos += N;
+		this->ReadLE(&arr[0], N);
 	}
 
 	template<typename T> typename std::enable_if_t<std::is_integral_v<T>> ReadLE(std::vector<T> &arr)
 	{
-		for (auto &item : arr)
-			item = this->ReadLE<T>();
+		this->ReadLE(arr.data(), arr.size());
 	}
 
-	void ReadLE(std::vector<std::uint8_t> &arr)
+	/*
+	 * Reads a count-prefixed array, the size is validated against the
+	 * remaining data before anything is allocated.
+	 */
+	template<typename T> typename std::enable_if_t<std::is_integral_v<T>, std::vector<T>> ReadLEVector(std::uint32_t count)
 	{
-		std::copy_n(&(*this->data)[this->pos], arr.size(), &arr[0]);
-		this->pos += arr.size();
+		this->CheckRemaining(static_cast<std::uint64_t>(count) * sizeof(T));
+		auto arr = std::vector<T>(count);
+		this->ReadLE(arr);
+		return arr;
 	}
 
-	std::string ReadNullTerminatedString()
+	std::string_view ReadNullTerminatedString()
 	{
-		char chr;
-		std::string str;
-		do
-		{
-			chr = static_cast<char>(this->ReadLE<std::uint8_t>());
-			if (chr)
-				str += chr;
-		} while (chr);
-		return str;
+		this->CheckRemaining(0);
+		auto start = this->data + this->pos;
+		auto end = static_cast<const std::uint8_t *>(std::memchr(start, 0, this->size - this->pos));
+		if (!end)
+			throw std::range_error("Unterminated string at offset " + std::to_string(this->pos) + " of the SDAT");
+		std::size_t length = end - start;
+		this->pos += static_cast<std::uint32_t>(length + 1);
+		return std::string_view(reinterpret_cast<const char *>(start), length);
 	}
 };
 
 /*
- * Data Reading
+ * Player state snapshots
  *
- * The following ReadLE functions will either read from a file or from an
- * array (sent in as a pointer), while making sure that the data is read in
- * as little-endian formating.
+ * A snapshot is only ever restored by the process that made it, so values
+ * are stored as-is in native byte order. Loading goes through PseudoFile so
+ * that a truncated snapshot throws instead of reading past its end.
  */
+template<typename T> inline void SaveStateValue(std::vector<std::uint8_t> &state, const T &value)
+{
+	static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be stored in a snapshot");
+	auto bytes = reinterpret_cast<const std::uint8_t *>(&value);
+	state.insert(state.end(), bytes, bytes + sizeof(T));
+}
 
-template<typename T> inline typename std::enable_if_t<std::is_integral_v<T>, T> ReadLE(const std::uint8_t *arr)
+template<typename T> inline void LoadStateValue(PseudoFile &file, T &value)
 {
-	T finalVal = 0;
-	for (std::size_t i = 0; i < sizeof(T); ++i)
-		finalVal |= arr[i] << (i * 8);
-	return finalVal;
+	static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be stored in a snapshot");
+	std::memcpy(&value, file.ReadBytes(sizeof(T)), sizeof(T));
 }
 
 /*
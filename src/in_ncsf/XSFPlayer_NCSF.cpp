@@ -12,7 +12,11 @@
 #include <atomic>
 #include <bitset>
 #include <filesystem>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
@@ -114,13 +118,38 @@ bool XSFPlayer_NCSF::LoadNCSF()
 	return this->RecursiveLoadNCSF(this->xSF.get(), 1);
 }
 
-XSFPlayer_NCSF::XSFPlayer_NCSF(const std::filesystem::path &path) : XSFPlayer(), sseq(0), sdatData(), sdat(), player(), secondsPerSample(0), secondsIntoPlayback(0), secondsUntilNextClock(0), mutes(), useSoundViewDialog(false)
+void XSFPlayer_NCSF::SetupPlayback(const std::vector<std::uint8_t> &data)
+{
+	auto file = PseudoFile(data);
+	this->sdat.reset(new SDAT(file, this->sseq));
+	auto *sseqToPlay = this->sdat->sseq.get();
+	this->player.allowedChannels = std::bitset<16>(this->sdat->player.channelMask);
+	this->player.sseqVol = Cnv_Scale(sseqToPlay->info.vol);
+	this->player.sampleRate = this->sampleRate;
+	this->player.Setup(sseqToPlay);
+	this->player.Timer();
+	this->secondsPerSample = 1.0 / this->sampleRate;
+	this->secondsIntoPlayback = 0;
+	this->secondsUntilNextClock = SecondsPerClockCycle;
+}
+
+XSFPlayer_NCSF::XSFPlayer_NCSF(const std::filesystem::path &path) : XSFPlayer(), sseq(0), sdatData(), sdat(), player(), secondsPerSample(0), secondsIntoPlayback(0), secondsUntilNextClock(0), mutes(), useSoundViewDialog(false),
+	soundViewThreadHandle(), savedStates(), samplesSinceLoad(0), nextSavedStateSample(std::numeric_limits<unsigned>::max())
 {
 	this->uses32BitSamplesClampedTo16Bit = true;
 	this->xSF.reset(new XSFFile(path, 8, 12));
 }
 
-static std::unique_ptr<std::thread> soundViewThreadHandle;
+// This creates a player for batch rendering, it has no file of its own and plays from the SDAT data of the source player
+XSFPlayer_NCSF::XSFPlayer_NCSF(const XSFPlayer_NCSF &source, std::uint32_t sseqToRender) : XSFPlayer(), sseq(sseqToRender), sdatData(), sdat(), player(), secondsPerSample(0), secondsIntoPlayback(0),
+	secondsUntilNextClock(0), mutes(source.mutes), useSoundViewDialog(false), soundViewThreadHandle(), savedStates(), samplesSinceLoad(0),
+	nextSavedStateSample(std::numeric_limits<unsigned>::max())
+{
+	this->uses32BitSamplesClampedTo16Bit = true;
+	this->sampleRate = source.sampleRate;
+	this->player.interpolation = source.player.interpolation;
+	this->SetupPlayback(source.sdatData);
+}
 
 static void soundViewThread(XSFPlayer_NCSF *player)
 {
@@ -138,30 +167,57 @@ bool XSFPlayer_NCSF::Load()
 		return false;
 
 	if (this->useSoundViewDialog)
-		soundViewThreadHandle.reset(new std::thread(soundViewThread, this));
+		this->soundViewThreadHandle.reset(new std::thread(soundViewThread, this));
 
-	PseudoFile file;
-	file.data = &this->sdatData;
-	this->sdat.reset(new SDAT(file, this->sseq));
-	auto *sseqToPlay = this->sdat->sseq.get();
-	this->player.allowedChannels = std::bitset<16>(this->sdat->player.channelMask);
-	this->player.sseqVol = Cnv_Scale(sseqToPlay->info.vol);
-	this->player.sampleRate = this->sampleRate;
-	this->player.Setup(sseqToPlay);
-	this->player.Timer();
-	this->secondsPerSample = 1.0 / this->sampleRate;
-	this->secondsIntoPlayback = 0;
-	this->secondsUntilNextClock = SecondsPerClockCycle;
+	this->SetupPlayback(this->sdatData);
+	this->savedStates.clear();
+	this->samplesSinceLoad = this->nextSavedStateSample = 0;
 
 	return XSFPlayer::Load();
 }
 
-void XSFPlayer_NCSF::GenerateSamples(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples)
+void XSFPlayer_NCSF::SaveState()
+{
+	if (!this->savedStates.count(this->samplesSinceLoad))
+	{
+		auto &state = this->savedStates[this->samplesSinceLoad];
+		this->player.SaveState(state);
+		SaveStateValue(state, this->secondsIntoPlayback);
+		SaveStateValue(state, this->secondsUntilNextClock);
+	}
+	this->nextSavedStateSample += SecondsBetweenSavedStates * this->sampleRate;
+}
+
+bool XSFPlayer_NCSF::FindSavedState(unsigned sample, unsigned &savedStateSample) const
+{
+	auto state = this->savedStates.upper_bound(sample);
+	if (state == this->savedStates.begin())
+		return false;
+	savedStateSample = std::prev(state)->first;
+	return true;
+}
+
+void XSFPlayer_NCSF::RestoreSavedState(unsigned savedStateSample)
+{
+	auto file = PseudoFile(this->savedStates.at(savedStateSample));
+	this->player.LoadState(file);
+	LoadStateValue(file, this->secondsIntoPlayback);
+	LoadStateValue(file, this->secondsUntilNextClock);
+	this->samplesSinceLoad = savedStateSample;
+	this->nextSavedStateSample = savedStateSample + SecondsBetweenSavedStates * this->sampleRate;
+}
+
+template<bool RenderStems> void XSFPlayer_NCSF::Render(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples, std::int32_t *stems, const std::bitset<16> &stemChannels)
 {
 	unsigned long mute = this->mutes.to_ulong();
+	unsigned long stemMask = stemChannels.to_ulong();
 
 	for (unsigned smpl = 0; smpl < samples; ++smpl)
 	{
+		if (this->samplesSinceLoad == this->nextSavedStateSample)
+			this->SaveState();
+		++this->samplesSinceLoad;
+
 		this->secondsIntoPlayback += this->secondsPerSample;
 
 		std::int32_t leftChannel = 0, rightChannel = 0;
@@ -170,13 +226,14 @@ void XSFPlayer_NCSF::GenerateSamples(std::vector<std::uint8_t> &buf, unsigned of
 		for (int i = 0; i < 16; ++i)
 		{
 			Channel &chn = this->player.channels[i];
+			bool isStem = RenderStems && (stemMask & BIT(i));
 
 			if (chn.state > ChannelState::None)
 			{
 				std::int32_t sample = chn.GenerateSample();
 				chn.IncrementSample();
 
-				if (mute & BIT(i))
+				if ((mute & BIT(i)) && !isStem)
 					continue;
 
 				std::uint8_t datashift = chn.reg.volumeDiv;
@@ -184,8 +241,25 @@ void XSFPlayer_NCSF::GenerateSamples(std::vector<std::uint8_t> &buf, unsigned of
 					datashift = 4;
 				sample = muldiv7(sample, chn.reg.volumeMul) >> datashift;
 
-				leftChannel += muldiv7(sample, 127 - chn.reg.panning);
-				rightChannel += muldiv7(sample, chn.reg.panning);
+				std::int32_t left = muldiv7(sample, 127 - chn.reg.panning);
+				std::int32_t right = muldiv7(sample, chn.reg.panning);
+
+				if (isStem)
+				{
+					*stems++ = left;
+					*stems++ = right;
+				}
+
+				if (!(mute & BIT(i)))
+				{
+					leftChannel += left;
+					rightChannel += right;
+				}
+			}
+			else if (isStem)
+			{
+				*stems++ = 0;
+				*stems++ = 0;
 			}
 		}
 
@@ -206,18 +280,67 @@ void XSFPlayer_NCSF::GenerateSamples(std::vector<std::uint8_t> &buf, unsigned of
 	}
 }
 
+void XSFPlayer_NCSF::GenerateSamples(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples)
+{
+	this->Render<false>(buf, offset, samples, nullptr, std::bitset<16>());
+}
+
+void XSFPlayer_NCSF::GenerateStems(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples, std::vector<std::int32_t> &stems, const std::bitset<16> &stemChannels)
+{
+	stems.resize(static_cast<std::size_t>(samples) * stemChannels.count() * 2);
+	this->Render<true>(buf, offset, samples, stems.data(), stemChannels);
+}
+
 void XSFPlayer_NCSF::Terminate()
 {
 	this->player.Stop(true);
 
-	if (soundViewThreadHandle)
+	if (this->soundViewThreadHandle)
 	{
 		static_cast<XSFApp_NCSF *>(xSFApp.get())->DestroySoundView();
-		soundViewThreadHandle->join();
-		soundViewThreadHandle.reset();
+		this->soundViewThreadHandle->join();
+		this->soundViewThreadHandle.reset();
 	}
 }
 
+void XSFPlayer_NCSF::RenderBatch(std::vector<NCSFBatchJob> &jobs, unsigned threads) const
+{
+	if (jobs.empty())
+		return;
+	if (!threads)
+		threads = std::max(std::thread::hardware_concurrency(), 1U);
+	threads = static_cast<unsigned>(std::min<std::size_t>(threads, jobs.size()));
+
+	// Each worker takes the next unclaimed job when it finishes one, so long and short SSEQs balance out across the threads
+	std::atomic<std::size_t> nextJob(0);
+	auto worker = [&]()
+	{
+		for (std::size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+		{
+			auto &job = jobs[i];
+			job.error.clear();
+			try
+			{
+				auto renderer = XSFPlayer_NCSF(*this, job.sseq);
+				job.output.resize(static_cast<std::size_t>(job.samples) << 3);
+				renderer.GenerateSamples(job.output, 0, job.samples);
+			}
+			catch (const std::exception &e)
+			{
+				job.output.clear();
+				job.error = e.what();
+			}
+		}
+	};
+
+	auto pool = std::vector<std::thread>();
+	for (unsigned i = 1; i < threads; ++i)
+		pool.emplace_back(worker);
+	worker();
+	for (auto &thread : pool)
+		thread.join();
+}
+
 void XSFPlayer_NCSF::SetUseSoundViewDialog(bool newUseSoundViewDialog)
 {
 	this->useSoundViewDialog = newUseSoundViewDialog;
@@ -12,8 +12,10 @@
 
 #include <bitset>
 #include <filesystem>
+#include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #include <cstddef>
 #include <cstdint>
@@ -23,6 +25,22 @@
 
 class XSFFile;
 
+/*
+ * A single SSEQ to render through XSFPlayer_NCSF::RenderBatch. The output is
+ * in the same format as GenerateSamples (interleaved stereo 32-bit samples).
+ * If the SSEQ could not be loaded, output will be empty and error will hold
+ * the reason.
+ */
+struct NCSFBatchJob
+{
+	std::uint32_t sseq;
+	unsigned samples;
+	std::vector<std::uint8_t> output;
+	std::string error;
+
+	NCSFBatchJob(std::uint32_t sseqToRender = 0, unsigned samplesToRender = 0) : sseq(sseqToRender), samples(samplesToRender), output(), error() { }
+};
+
 class XSFPlayer_NCSF : public XSFPlayer
 {
 	std::uint32_t sseq;
@@ -32,17 +50,50 @@ class XSFPlayer_NCSF : public XSFPlayer
 	double secondsPerSample, secondsIntoPlayback, secondsUntilNextClock;
 	std::bitset<16> mutes;
 	bool useSoundViewDialog;
+	std::unique_ptr<std::thread> soundViewThreadHandle;
+	/*
+	 * Snapshots of the player taken every SecondsBetweenSavedStates during
+	 * playback, keyed by the number of samples generated since Load, so that
+	 * seeking only has to generate the samples after the closest one.
+	 */
+	static constexpr unsigned SecondsBetweenSavedStates = 5;
+	std::map<unsigned, std::vector<std::uint8_t>> savedStates;
+	unsigned samplesSinceLoad, nextSavedStateSample;
 
 	void MapNCSFSection(const std::vector<std::uint8_t> &section);
 	bool MapNCSF(XSFFile *xSFToLoad);
 	bool RecursiveLoadNCSF(XSFFile *xSFToLoad, int level);
 	bool LoadNCSF();
+	void SetupPlayback(const std::vector<std::uint8_t> &data);
+	void SaveState();
+	XSFPlayer_NCSF(const XSFPlayer_NCSF &source, std::uint32_t sseqToRender);
+	template<bool RenderStems> void Render(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples, std::int32_t *stems, const std::bitset<16> &stemChannels);
 public:
 	XSFPlayer_NCSF(const std::filesystem::path &path);
 	~XSFPlayer_NCSF() override;
 	bool Load() override;
 	void GenerateSamples(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples) override;
+	/*
+	 * Renders the same output as GenerateSamples into buf (the master mix, with
+	 * the mutes applied), while also writing the post-volume/pan output of
+	 * each channel in stemChannels to stems in a single pass. The stems are
+	 * interleaved per sample, in channel order, as left/right pairs of 32-bit
+	 * samples, so stems is resized to samples * stemChannels.count() * 2.
+	 * Stems are not affected by the mutes.
+	 */
+	void GenerateStems(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples, std::vector<std::int32_t> &stems,
+		const std::bitset<16> &stemChannels = std::bitset<16>().set());
 	void Terminate() override;
+	bool FindSavedState(unsigned sample, unsigned &savedStateSample) const override;
+	void RestoreSavedState(unsigned savedStateSample) override;
+	/*
+	 * Renders each of the given SSEQs from this player's SDAT from the start,
+	 * concurrently on the given number of threads (0 meaning one per hardware
+	 * thread). Load must have been called first. The sample rate,
+	 * interpolation and mutes of this player are used for every job, and this
+	 * player's own playback state is left untouched.
+	 */
+	void RenderBatch(std::vector<NCSFBatchJob> &jobs, unsigned threads = 0) const;
 
 	void SetUseSoundViewDialog(bool newUseSoundViewDialog);
 	void SetInterpolation(unsigned interpolation);
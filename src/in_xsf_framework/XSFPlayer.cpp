@@ -241,11 +241,27 @@ int XSFPlayer::Seek(unsigned seekPosition, volatile int *killswitch, std::vector
 {
 	unsigned bufsize = buf.size() >> 2, seekSample = static_cast<std::uint64_t>(seekPosition) * this->sampleRate / 1000;
 	DWORD prevTick = outMod ? GetTickCount() : 0;
+	unsigned savedStateSample = 0;
+	bool hasSavedState = this->FindSavedState(seekSample, savedStateSample);
 	if (seekSample < this->currentSample)
 	{
-		this->Terminate();
-		this->Load();
-		this->SeekTop();
+		if (!hasSavedState)
+		{
+			this->Terminate();
+			this->Load();
+			this->SeekTop();
+		}
+		else
+		{
+			this->RestoreSavedState(savedStateSample);
+			this->SeekTop();
+			this->currentSample = savedStateSample;
+		}
+	}
+	else if (hasSavedState && savedStateSample > this->currentSample)
+	{
+		this->RestoreSavedState(savedStateSample);
+		this->currentSample = savedStateSample;
 	}
 	while (seekSample - this->currentSample > bufsize)
 	{
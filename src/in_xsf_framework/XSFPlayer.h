@@ -52,6 +52,14 @@ public:
 	bool FillBuffer(std::vector<std::uint8_t> &buf, unsigned &samplesWritten);
 	virtual void GenerateSamples(std::vector<std::uint8_t> &buf, unsigned offset, unsigned samples) = 0;
 	void SeekTop();
+	/*
+	 * Players that keep snapshots of their state during playback can override
+	 * these so seeking does not have to regenerate everything from the start.
+	 * FindSavedState should return the latest snapshot at or before the given
+	 * sample (a sample count since Load), RestoreSavedState restores it.
+	 */
+	virtual bool FindSavedState(unsigned, unsigned &) const { return false; }
+	virtual void RestoreSavedState(unsigned) { }
 #ifdef WINAMP_PLUGIN
 	int Seek(unsigned seekPosition, volatile int *killswitch, std::vector<std::uint8_t> &buf, Out_Module *outMod);
 #endif